@@ -241,6 +241,20 @@ protected:
 
 		return def::GameEngine::Draw(nx, ny, col);
 	}
+
+	// The lines write the pixels directly so they are stepped here to wrap the wireframes too
+	using def::GameEngine::DrawLine;
+
+	void DrawLine(int x1, int y1, int x2, int y2, const def::Pixel& col = def::WHITE) override
+	{
+		int steps = std::max(abs(x2 - x1), abs(y2 - y1));
+
+		for (int i = 0; i <= steps; i++)
+		{
+			float t = steps > 0 ? (float)i / (float)steps : 0.0f;
+			Draw((int)roundf(x1 + (x2 - x1) * t), (int)roundf(y1 + (y2 - y1) * t), col);
+		}
+	}
 	
 };
 
@@ -162,6 +162,15 @@ protected:
 		return def::GameEngine::Draw(x, y % yBorder, p);
 	}
 
+	// Filling writes whole rows at once so it has to wrap them too
+	using def::GameEngine::FillRectangle;
+
+	virtual void FillRectangle(int32_t x, int32_t y, int32_t sizeX, int32_t sizeY, const def::Pixel& p) override
+	{
+		for (int32_t i = 0; i < sizeY; i++)
+			def::GameEngine::FillRectangle(x, (y + i) % yBorder, sizeX, 1, p);
+	}
+
 };
 
 int main()
@@ -19,7 +19,8 @@ private:
 
 	static float Distance(Node* n1, Node* n2)
 	{
-		return (n1->pos - n2->pos).length();
+		// The incremental search needs a heuristic that is never bigger than the distance
+		return (def::vf2d(n1->pos) - def::vf2d(n2->pos)).length();
 	}
 
 	static float Heuristic(Node* n1, Node* n2)
@@ -33,8 +34,7 @@ protected:
 		pathFinder.ConstructMap({ 16, 16 });
 		pathFinder.SetNodes({ 1, 8 }, { 14, 8 });
 
-		pathFinder.ClearMap();
-		pathFinder.FindPath(&Distance, &Heuristic);
+		pathFinder.FindPathIncremental(&Distance, &Heuristic);
 
 		return true;
 	}
@@ -61,11 +61,11 @@ protected:
 				else
 				{
 					if (&nodes[p] != pathFinder.GetStartNode() && &nodes[p] != pathFinder.GetGoalNode())
-						nodes[p].isObstacle = !nodes[p].isObstacle;
+						pathFinder.SetObstacle(selectedNode, !nodes[p].isObstacle);
 				}
 
-				pathFinder.ClearMap();
-				pathFinder.FindPath(&Distance, &Heuristic);
+				// Only the nodes around the change are searched again
+				pathFinder.FindPathIncremental(&Distance, &Heuristic);
 			}
 		}
 
@@ -75,11 +75,14 @@ protected:
 		for (i.x = 0; i.x < pathFinder.GetMapWidth(); i.x++)
 			for (i.y = 0; i.y < pathFinder.GetMapHeight(); i.y++)
 			{
-				for (auto n : nodes[i.y * pathFinder.GetMapWidth() + i.x].neighbours)
+				Node* neighbours[8];
+				int count = pathFinder.GetNeighbours(&nodes[i.y * pathFinder.GetMapWidth() + i.x], neighbours);
+
+				for (int j = 0; j < count; j++)
 				{
 					DrawLine(
 						i * nodeSize + nodeSize / 2,
-						n->pos * nodeSize + nodeSize / 2,
+						neighbours[j]->pos * nodeSize + nodeSize / 2,
 						def::DARK_BLUE);
 				}
 			}
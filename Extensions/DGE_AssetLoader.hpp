@@ -0,0 +1,333 @@
+#ifndef DGE_ASSET_LOADER_HPP
+#define DGE_ASSET_LOADER_HPP
+
+#pragma region Includes
+
+#include <deque>
+#include <limits>
+#include <unordered_map>
+#include <algorithm>
+
+#include "../defGameEngine.hpp"
+
+#pragma endregion
+
+namespace def
+{
+	// An image that is decoded on a worker and uploaded by AssetLoader::Update
+	class Asset
+	{
+	public:
+		friend class AssetLoader;
+
+		enum class State { QUEUED, DECODED, RESIDENT, FAILED };
+
+		State GetState() const;
+		bool IsResident() const;
+
+		const std::string& GetFileName() const;
+
+		// Both return nullptr until the asset is resident
+		Graphic* GetGraphic() const;
+		const Texture* GetTexture() const;
+
+	private:
+		std::string m_FileName;
+		bool m_Mipmaps;
+
+		std::atomic<State> m_State;
+
+		Sprite* m_Sprite = nullptr;
+		Graphic* m_Graphic = nullptr;
+
+		// The link of the completion queue
+		Asset* m_Next = nullptr;
+
+	};
+
+	class AssetLoader
+	{
+	public:
+		// 0 threads leaves one core for the main thread
+		AssetLoader(uint32_t threads = 0);
+		~AssetLoader();
+
+	public:
+		// Queues the file for decoding, the same file is loaded only once.
+		// The asset is owned by the loader
+		Asset* Load(std::string_view fileName, bool mipmaps = false);
+
+		// Uploads the decoded sprites until the budget in seconds runs out,
+		// at least one is uploaded on every call so the queue always moves
+		void Update(float budget = 0.002f);
+
+		// Blocks until every queued asset is resident or failed
+		void Wait();
+
+		size_t GetPendingCount() const;
+
+		// Draws nothing until the asset is resident
+		void Draw(const vf2d& pos, const Asset* asset, const vf2d& scale = { 1.0f, 1.0f }, const Pixel& tint = WHITE);
+
+	private:
+		void Decode(Asset* asset);
+		void Upload(Asset* asset);
+
+#ifndef PLATFORM_EMSCRIPTEN
+		void Worker();
+#endif
+
+	private:
+		std::unordered_map<std::string, Asset*> m_Assets;
+
+		std::deque<Asset*> m_Requests;
+
+		// Finished assets are pushed by the workers and taken all at once by Update,
+		// the list is the newest first
+		std::atomic<Asset*> m_Completed;
+
+		// Taken from m_Completed and waiting for the upload, only the main thread uses it
+		std::deque<Asset*> m_Decoded;
+
+		size_t m_Pending;
+
+#ifndef PLATFORM_EMSCRIPTEN
+		std::vector<std::thread> m_Workers;
+
+		std::mutex m_RequestsMutex;
+		std::condition_variable m_RequestsReady;
+
+		bool m_StopWorkers;
+#endif
+
+		GameEngine* m_Engine;
+
+	};
+
+#ifdef DGE_ASSET_LOADER
+#undef DGE_ASSET_LOADER
+
+	Asset::State Asset::GetState() const
+	{
+		return m_State;
+	}
+
+	bool Asset::IsResident() const
+	{
+		return m_State == State::RESIDENT;
+	}
+
+	const std::string& Asset::GetFileName() const
+	{
+		return m_FileName;
+	}
+
+	Graphic* Asset::GetGraphic() const
+	{
+		return IsResident() ? m_Graphic : nullptr;
+	}
+
+	const Texture* Asset::GetTexture() const
+	{
+		return IsResident() ? m_Graphic->texture : nullptr;
+	}
+
+	AssetLoader::AssetLoader(uint32_t threads)
+	{
+		m_Completed = nullptr;
+		m_Pending = 0;
+		m_Engine = GameEngine::s_Engine;
+
+#ifndef PLATFORM_EMSCRIPTEN
+		m_StopWorkers = false;
+
+		if (threads == 0)
+			threads = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+
+		for (uint32_t i = 0; i < threads; i++)
+			m_Workers.emplace_back(&AssetLoader::Worker, this);
+#endif
+	}
+
+	AssetLoader::~AssetLoader()
+	{
+#ifndef PLATFORM_EMSCRIPTEN
+		{
+			std::lock_guard<std::mutex> lock(m_RequestsMutex);
+			m_StopWorkers = true;
+		}
+
+		m_RequestsReady.notify_all();
+
+		for (auto& worker : m_Workers)
+			worker.join();
+#endif
+
+		for (auto& [fileName, asset] : m_Assets)
+		{
+			if (asset->m_Graphic)
+				delete asset->m_Graphic;
+			else
+				delete asset->m_Sprite;
+
+			delete asset;
+		}
+	}
+
+	Asset* AssetLoader::Load(std::string_view fileName, bool mipmaps)
+	{
+		auto found = m_Assets.find(std::string(fileName));
+
+		if (found != m_Assets.end())
+			return found->second;
+
+		Asset* asset = new Asset();
+
+		asset->m_FileName = fileName;
+		asset->m_Mipmaps = mipmaps;
+		asset->m_State = Asset::State::QUEUED;
+
+		m_Assets[asset->m_FileName] = asset;
+		m_Pending++;
+
+#ifndef PLATFORM_EMSCRIPTEN
+		{
+			std::lock_guard<std::mutex> lock(m_RequestsMutex);
+			m_Requests.push_back(asset);
+		}
+
+		m_RequestsReady.notify_one();
+#else
+		m_Requests.push_back(asset);
+#endif
+
+		return asset;
+	}
+
+	void AssetLoader::Update(float budget)
+	{
+		auto start = std::chrono::steady_clock::now();
+
+		auto elapsed = [&start]()
+			{
+				return std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+			};
+
+#ifdef PLATFORM_EMSCRIPTEN
+		// There are no workers so the files are decoded here under the same budget
+		for (bool first = true; !m_Requests.empty() && (first || elapsed() < budget); first = false)
+		{
+			Decode(m_Requests.front());
+			m_Requests.pop_front();
+		}
+#endif
+
+		size_t oldest = m_Decoded.size();
+
+		for (Asset* asset = m_Completed.exchange(nullptr, std::memory_order_acquire); asset; asset = asset->m_Next)
+			m_Decoded.push_back(asset);
+
+		std::reverse(m_Decoded.begin() + oldest, m_Decoded.end());
+
+		for (bool first = true; !m_Decoded.empty() && (first || elapsed() < budget);)
+		{
+			Asset* asset = m_Decoded.front();
+			m_Decoded.pop_front();
+
+			m_Pending--;
+
+			// Failed assets don't take time from the budget
+			if (asset->m_State == Asset::State::FAILED)
+				continue;
+
+			Upload(asset);
+			first = false;
+		}
+	}
+
+	void AssetLoader::Wait()
+	{
+		while (m_Pending > 0)
+		{
+			Update(std::numeric_limits<float>::max());
+
+			if (m_Pending > 0)
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+
+	size_t AssetLoader::GetPendingCount() const
+	{
+		return m_Pending;
+	}
+
+	void AssetLoader::Draw(const vf2d& pos, const Asset* asset, const vf2d& scale, const Pixel& tint)
+	{
+		if (asset && asset->IsResident())
+			m_Engine->DrawTexture(pos, asset->m_Graphic->texture, scale, tint);
+	}
+
+	void AssetLoader::Decode(Asset* asset)
+	{
+		// Sprite::Load would stop the application from the worker on a missing or broken file
+		Sprite* sprite = new Sprite();
+
+		if (sprite->TryLoad(asset->m_FileName))
+		{
+			// The levels are built here instead of during the upload
+			if (asset->m_Mipmaps)
+				sprite->GetMipLevel(1);
+
+			asset->m_Sprite = sprite;
+			asset->m_State = Asset::State::DECODED;
+		}
+		else
+		{
+			delete sprite;
+			asset->m_State = Asset::State::FAILED;
+		}
+
+		Asset* head = m_Completed.load(std::memory_order_relaxed);
+
+		do asset->m_Next = head;
+		while (!m_Completed.compare_exchange_weak(head, asset, std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	void AssetLoader::Upload(Asset* asset)
+	{
+		Graphic* graphic = new Graphic();
+
+		graphic->sprite = asset->m_Sprite;
+		graphic->texture = new Texture(asset->m_Sprite, asset->m_Mipmaps);
+
+		asset->m_Graphic = graphic;
+		asset->m_State = Asset::State::RESIDENT;
+	}
+
+#ifndef PLATFORM_EMSCRIPTEN
+	void AssetLoader::Worker()
+	{
+		while (true)
+		{
+			Asset* asset;
+
+			{
+				std::unique_lock<std::mutex> lock(m_RequestsMutex);
+				m_RequestsReady.wait(lock, [this] { return m_StopWorkers || !m_Requests.empty(); });
+
+				if (m_StopWorkers)
+					return;
+
+				asset = m_Requests.front();
+				m_Requests.pop_front();
+			}
+
+			Decode(asset);
+		}
+	}
+#endif
+
+#endif
+}
+
+#endif
@@ -3,10 +3,13 @@
 
 #pragma region Includes
 
-#include <list>
 #include <cmath>
 #include <functional>
 #include <vector>
+#include <bit>
+#include <atomic>
+#include <thread>
+#include <unordered_map>
 
 #include "../defGameEngine.hpp"
 
@@ -26,10 +29,41 @@ namespace def
 
 		def::vi2d pos;
 
-		std::vector<Node*> neighbours;
 		Node* parent;
 	};
 
+	// Costs to reach a goal from every node of a map and the neighbour to step on from each of them,
+	// any number of agents can follow it to the same goal
+	class FlowField
+	{
+	public:
+		friend class PathFinder;
+
+		def::vi2d GetMapSize() const;
+		def::vi2d GetGoal() const;
+
+		// INFINITY if the goal can't be reached from the position
+		float GetCost(const def::vi2d& pos) const;
+
+		// The step towards the goal, { 0, 0 } at the goal and where it can't be reached
+		def::vi2d GetDirection(const def::vi2d& pos) const;
+
+		// The positions from the start to the goal, empty if the goal can't be reached
+		std::vector<def::vi2d> GetPath(const def::vi2d& start) const;
+
+	private:
+		static constexpr int s_Directions[8][2] = { { 0, -1 }, { 0, 1 }, { -1, 0 }, { 1, 0 }, { -1, -1 }, { 1, 1 }, { -1, 1 }, { 1, -1 } };
+
+		def::vi2d m_MapSize;
+		def::vi2d m_Goal;
+
+		std::vector<float> m_Costs;
+
+		// Indices into s_Directions, -1 where there is no step
+		std::vector<int8_t> m_Directions;
+
+	};
+
 	class PathFinder
 	{
 	public:
@@ -37,14 +71,144 @@ namespace def
 		~PathFinder();
 
 	private:
+		enum class State : uint8_t { UNSEEN, OPEN, CLOSED };
+
+		// Binary heap of node indices that knows where every node is so its key can be changed
+		template <class Key>
+		struct IndexedHeap
+		{
+			void Resize(size_t count, const Key& key);
+
+			bool IsEmpty() const;
+			bool Contains(int node) const;
+
+			int Top() const;
+			const Key& TopKey() const;
+
+			void Push(int node, const Key& key);
+			int Pop();
+
+			// Moves the node up or down for the new key
+			void Update(int node, const Key& key);
+			void Remove(int node);
+
+			// Takes out the nodes that are still in the heap, the keys stay
+			void Clear();
+
+			void SiftUp(int position);
+			void SiftDown(int position);
+
+			std::vector<int> nodes;
+
+			// By the index of a node, -1 if the node isn't in the heap
+			std::vector<int> positions;
+			std::vector<Key> keys;
+		};
+
 		def::vi2d m_MapSize;
 
-		Node* m_Nodes;
+		std::vector<Node> m_Nodes;
 
 		Node* m_Start;
 		Node* m_Goal;
 
-		bool m_IsMapFreed;
+		// The state of the search by the index of a node, the nodes get the results
+		// when the search is over and the entries that were touched are reset
+		std::vector<float> m_Costs;
+		std::vector<int> m_Parents;
+		std::vector<State> m_States;
+
+		std::vector<int> m_Touched;
+
+		// The open nodes by their priorities
+		IndexedHeap<float> m_Open;
+
+		// Bits of the nodes that aren't obstacles by rows and by columns for the jumps,
+		// there is a border of one blocked node around the map
+		std::vector<uint64_t> m_RowBits;
+		std::vector<uint64_t> m_ColumnBits;
+
+		int m_RowWords;
+		int m_ColumnWords;
+
+		// What FindPathIncremental keeps between the calls, it searches from the goal
+		// so the costs stay valid when the start moves
+		struct IncrementalSearch
+		{
+			// -1 until the first call and after the map was constructed again
+			int goal = -1;
+			int lastStart = -1;
+
+			float (*dist)(Node*, Node*) = nullptr;
+			float (*heuristic)(Node*, Node*) = nullptr;
+
+			// The cost to the goal and the one seen from the neighbours
+			std::vector<float> g;
+			std::vector<float> rhs;
+
+			// Keys are compared by the first value and then by the second one
+			IndexedHeap<std::pair<float, float>> open;
+
+			// Grows by the heuristic between the old and the new start so the keys in the heap stay valid
+			float keyModifier = 0.0f;
+
+			// Nodes whose obstacles changed since the last call
+			std::vector<int> changed;
+
+			// Nodes that the last call marked on the map
+			std::vector<int> visited;
+			std::vector<int> path;
+		};
+
+		IncrementalSearch m_Incremental;
+
+		struct ClusterEdge
+		{
+			int to;
+			float cost;
+
+			// The nodes after the first one up to the last one
+			std::vector<int> path;
+		};
+
+		struct Cluster
+		{
+			def::vi2d pos;
+			def::vi2d size;
+
+			// The nodes on both sides of the right and the bottom borders where an entrance crosses them straight
+			// or diagonally, the first one is in this cluster and the second one can be in a corner cluster
+			std::vector<std::pair<int, int>> rightEntrances;
+			std::vector<std::pair<int, int>> bottomEntrances;
+
+			// The nodes of the entrances on every side and the edges from each of them
+			// across the borders and, once the node is searched from, to the other ones
+			std::vector<int> nodes;
+			std::vector<std::vector<ClusterEdge>> edges;
+			std::vector<bool> isSearched;
+
+			bool areEntrancesValid;
+			bool areEdgesValid;
+		};
+
+		// The map cut into squares for FindPathHierarchical, a cluster is built the first time the search
+		// reaches it and again only after an obstacle in it or on its borders changes,
+		// the edges inside of it are found only from the entrances that the search expands
+		std::vector<Cluster> m_Clusters;
+
+		def::vi2d m_ClusterCount;
+		int m_ClusterSize;
+
+		float (*m_ClusterDist)(Node*, Node*);
+
+		// The index of a node in the nodes of its cluster, -1 if it isn't an entrance
+		std::vector<int> m_EntranceIndices;
+
+		// SearchCluster runs for every expanded entrance so its buffers are kept between the calls
+		std::vector<float> m_ClusterCosts;
+		std::vector<int> m_ClusterParents;
+		mutable std::vector<std::pair<float, int>> m_ClusterOpen;
+		mutable std::vector<bool> m_ClusterTargets;
 
 	public:
 		void ClearMap();
@@ -64,8 +228,93 @@ namespace def
 		int GetMapHeight() const;
 		def::vi2d GetMapSize() const;
 
+		// FindPathJPS, FindPathIncremental and FindPathHierarchical read the obstacles from a copy of the map,
+		// SetObstacle keeps it up to date and UpdateObstacles copies the changes after isObstacle was changed directly
+		bool SetObstacle(const def::vi2d& pos, bool isObstacle);
+		void UpdateObstacles();
+
+		// Writes up to 8 nodes around the node to neighbours and returns how many there are
+		int GetNeighbours(const Node* node, Node* neighbours[8]);
+
 		void FindPath(float (*dist)(Node*, Node*), float (*heuristic)(Node*, Node*));
 
+		// Jump Point Search for grids where a straight step costs 1 and a diagonal one costs sqrt(2),
+		// the path costs the same as the one of FindPath with the euclidean distance.
+		// Only the jump points are visited, the nodes between them are linked to the path afterwards
+		void FindPathJPS(float (*heuristic)(Node*, Node*));
+
+		// D* Lite, the search is kept between the calls and only the nodes around the changed obstacles
+		// and the moved start are searched again. It starts over when the goal or the functions change,
+		// the heuristic must never be bigger than the distance. The nodes of the path are linked from the goal
+		// to the start and the nodes that were searched by this call are visited
+		void FindPathIncremental(float (*dist)(Node*, Node*), float (*heuristic)(Node*, Node*));
+
+		// HPA*, the map is cut into clusters of clusterSize nodes on a side and the paths between the entrances
+		// of every cluster are kept. The search goes only over the entrances and the path is filled in from the kept ones,
+		// it's close to the shortest one but not always the same. The entrance nodes are visited
+		void FindPathHierarchical(float (*dist)(Node*, Node*), float (*heuristic)(Node*, Node*), int clusterSize = 16);
+
+		// Dijkstra from the goal to every node, dist is called with the node to step from first.
+		// It only reads the map so fields of different goals can be built at the same time
+		bool BuildFlowField(const def::vi2d& goal, FlowField& field, float (*dist)(Node*, Node*)) const;
+
+		// Builds the field of every goal on the given number of threads, 0 uses every core
+		void BuildFlowFields(const std::vector<def::vi2d>& goals, std::vector<FlowField>& fields, float (*dist)(Node*, Node*), uint32_t threads = 0) const;
+
+	private:
+		template <class Func>
+		void ForEachNeighbour(int index, Func&& func) const;
+
+		// Lowers the cost of the node if the new one is better and (re)opens it
+		void Relax(int index, int parent, float cost, float (*heuristic)(Node*, Node*));
+
+		bool IsWalkable(int x, int y) const;
+		void SetWalkable(int x, int y, bool isWalkable);
+
+		// Moves from the node in the direction until a node with a forced neighbour or the goal,
+		// returns -1 if it hits an obstacle or the edge of the map
+		int Jump(int x, int y, int dx, int dy, int goal) const;
+
+		// Returns the first position after from in the direction that is blocked on the line
+		// or that has a node next to it on a side that is free after a blocked one
+		static int Scan(const uint64_t* line, const uint64_t* side0, const uint64_t* side1, int words, int from, int dir);
+
+		void StoreResults();
+
+		// INFINITY if one of the nodes is an obstacle
+		float GetEdgeCost(int from, int to) const;
+
+		std::pair<float, float> GetIncrementalKey(int index) const;
+
+		// Takes rhs from the best neighbour and puts the node into the heap if it's inconsistent
+		void UpdateIncremental(int index);
+		void UpdateIncrementalKey(int index);
+
+		void ComputeIncremental(int start);
+
+		// Lets the incremental search and the clusters know that the obstacle of the node changed
+		void OnObstacleChanged(int index);
+
+		void BuildClusters(int clusterSize, float (*dist)(Node*, Node*));
+		// Finds the edges of the cluster and the entrances that it takes its nodes from
+		void UpdateCluster(Cluster& cluster);
+
+		void InvalidateCluster(int x, int y, bool entrances);
+		Cluster& GetCluster(int index);
+
+		// The position of the node among the nodes of the cluster
+		int GetClusterPosition(const Cluster& cluster, int index) const;
+
+		void FindEntrances(Cluster& cluster);
+		void FindClusterEdges(Cluster& cluster);
+
+		// Adds the edges from the entrance to the other ones in its cluster
+		void SearchEntrance(Cluster& cluster, int entrance);
+
+		// Dijkstra over the nodes of the cluster from the node, backward finds the costs of reaching the node instead.
+		// It stops once all of the targets are reached, the costs and the parents are written by the position of a node in the cluster
+		void SearchCluster(const Cluster& cluster, int from, bool backward, const std::vector<int>& targets, std::vector<float>& costs, std::vector<int>& parents) const;
+
 	};
 
 #ifdef DGE_PATHFINDER
@@ -87,7 +336,8 @@ namespace def
 		m_Start = nullptr;
 		m_Goal = nullptr;
 
-		m_IsMapFreed = false;
+		m_ClusterSize = 0;
+		m_ClusterDist = nullptr;
 	}
 
 	PathFinder::~PathFinder()
@@ -115,62 +365,52 @@ namespace def
 
 	bool PathFinder::FreeMap()
 	{
-		if (!m_IsMapFreed)
-		{
-			delete[] m_Nodes;
-			m_IsMapFreed = true;
-		}
+		m_Nodes.clear();
 
-		return m_IsMapFreed;
-	}
+		m_Costs.clear();
+		m_Parents.clear();
+		m_States.clear();
 
-	bool PathFinder::ConstructMap(const def::vi2d& size)
-	{
-		if (size.x <= 0 || size.y <= 0)
-			return false;
+		m_Open.Resize(0, INFINITY);
 
-		m_MapSize = size;
+		m_RowBits.clear();
+		m_ColumnBits.clear();
 
-		if (FreeMap())
-			m_IsMapFreed = false;
+		m_Incremental = IncrementalSearch();
 
-		m_Nodes = new Node[size.x * size.y];
+		m_Clusters.clear();
+		m_EntranceIndices.clear();
 
-		ClearMap();
+		m_ClusterSize = 0;
+		m_ClusterDist = nullptr;
 
-		for (int x = 0; x < size.x; x++)
-			for (int y = 0; y < size.y; y++)
-			{
-				bool topFits = y > 0;
-				bool bottomFits = y < size.y - 1;
+		m_Start = nullptr;
+		m_Goal = nullptr;
+
+		return true;
+	}
 
-				bool leftFits = x > 0;
-				bool rightFits = x < size.x - 1;
+	bool PathFinder::ConstructMap(const def::vi2d& size)
+	{
+		if (size.x <= 0 || size.y <= 0)
+			return false;
 
-				if (topFits)
-					m_Nodes[y * size.x + x].neighbours.push_back(&m_Nodes[(y - 1) * size.x + x]);
+		FreeMap();
 
-				if (bottomFits)
-					m_Nodes[y * size.x + x].neighbours.push_back(&m_Nodes[(y + 1) * size.x + x]);
+		m_MapSize = size;
 
-				if (leftFits)
-					m_Nodes[y * size.x + x].neighbours.push_back(&m_Nodes[y * size.x + x - 1]);
+		size_t count = size.x * size.y;
 
-				if (rightFits)
-					m_Nodes[y * size.x + x].neighbours.push_back(&m_Nodes[y * size.x + x + 1]);
-			
-				if (topFits && leftFits)
-					m_Nodes[y * size.x + x].neighbours.push_back(&m_Nodes[(y - 1) * size.x + x - 1]);
+		m_Nodes.resize(count);
 
-				if (bottomFits && rightFits)
-					m_Nodes[y * size.x + x].neighbours.push_back(&m_Nodes[(y + 1) * size.x + x + 1]);
+		m_Costs.assign(count, INFINITY);
+		m_Parents.assign(count, -1);
+		m_States.assign(count, State::UNSEEN);
 
-				if (leftFits && bottomFits)
-					m_Nodes[y * size.x + x].neighbours.push_back(&m_Nodes[(y + 1) * size.x + x - 1]);
+		m_Open.Resize(count, INFINITY);
 
-				if (rightFits && topFits)
-					m_Nodes[y * size.x + x].neighbours.push_back(&m_Nodes[(y - 1) * size.x + x + 1]);
-			}
+		ClearMap();
+		UpdateObstacles();
 
 		return true;
 	}
@@ -210,7 +450,7 @@ namespace def
 
 	Node* PathFinder::GetNodes()
 	{
-		return m_Nodes;
+		return m_Nodes.data();
 	}
 	
 	int PathFinder::GetMapWidth() const
@@ -228,45 +468,1442 @@ namespace def
 		return m_MapSize;
 	}
 
+	int PathFinder::GetNeighbours(const Node* node, Node* neighbours[8])
+	{
+		int count = 0;
+
+		ForEachNeighbour(int(node - m_Nodes.data()),
+			[&](int index) { neighbours[count++] = &m_Nodes[index]; });
+
+		return count;
+	}
+
 	void PathFinder::FindPath(float (*dist)(Node*, Node*), float (*heuristic)(Node*, Node*))
 	{
-		Node* current = m_Start;
-		current->localGoal = 0.0f;
-		current->globalGoal = heuristic(current, m_Goal);
+		if (!m_Start || !m_Goal)
+			return;
+
+		int start = int(m_Start - m_Nodes.data());
+		int goal = int(m_Goal - m_Nodes.data());
+
+		m_Touched.push_back(start);
+		m_Costs[start] = 0.0f;
+		m_States[start] = State::OPEN;
+		m_Open.Push(start, heuristic(m_Start, m_Goal));
+
+		while (!m_Open.IsEmpty())
+		{
+			int current = m_Open.Pop();
+			m_States[current] = State::CLOSED;
+
+			if (current == goal)
+				break;
+
+			Node* currentNode = &m_Nodes[current];
+
+			ForEachNeighbour(current, [&](int next)
+				{
+					if (m_States[next] != State::CLOSED && !m_Nodes[next].isObstacle)
+						Relax(next, current, m_Costs[current] + dist(currentNode, &m_Nodes[next]), heuristic);
+				});
+		}
+
+		StoreResults();
+	}
+
+	void PathFinder::FindPathJPS(float (*heuristic)(Node*, Node*))
+	{
+		if (!m_Start || !m_Goal)
+			return;
+
+		const float diagonalCost = std::sqrt(2.0f);
+
+		int start = int(m_Start - m_Nodes.data());
+		int goal = int(m_Goal - m_Nodes.data());
+
+		m_Touched.push_back(start);
+		m_Costs[start] = 0.0f;
+		m_States[start] = State::OPEN;
+		m_Open.Push(start, heuristic(m_Start, m_Goal));
+
+		while (!m_Open.IsEmpty())
+		{
+			int current = m_Open.Pop();
+			m_States[current] = State::CLOSED;
+
+			if (current == goal)
+				break;
+
+			int x = current % m_MapSize.x;
+			int y = current / m_MapSize.x;
+
+			// The directions that are worth following from the node
+			int directions[8][2];
+			int count = 0;
+
+			auto follow = [&](int dx, int dy)
+				{
+					if (IsWalkable(x + dx, y + dy))
+					{
+						directions[count][0] = dx;
+						directions[count][1] = dy;
+						count++;
+					}
+				};
+
+			if (m_Parents[current] == -1)
+			{
+				for (int dy = -1; dy <= 1; dy++)
+					for (int dx = -1; dx <= 1; dx++)
+					{
+						if (dx != 0 || dy != 0)
+							follow(dx, dy);
+					}
+			}
+			else
+			{
+				int parentX = m_Parents[current] % m_MapSize.x;
+				int parentY = m_Parents[current] / m_MapSize.x;
+
+				int dx = (x > parentX) - (x < parentX);
+				int dy = (y > parentY) - (y < parentY);
+
+				// The natural neighbours and the forced ones next to the obstacles
+				if (dx != 0 && dy != 0)
+				{
+					follow(dx, 0);
+					follow(0, dy);
+					follow(dx, dy);
+
+					if (!IsWalkable(x - dx, y)) follow(-dx, dy);
+					if (!IsWalkable(x, y - dy)) follow(dx, -dy);
+				}
+				else if (dx != 0)
+				{
+					follow(dx, 0);
+
+					if (!IsWalkable(x, y + 1)) follow(dx, 1);
+					if (!IsWalkable(x, y - 1)) follow(dx, -1);
+				}
+				else
+				{
+					follow(0, dy);
+
+					if (!IsWalkable(x + 1, y)) follow(1, dy);
+					if (!IsWalkable(x - 1, y)) follow(-1, dy);
+				}
+			}
+
+			for (int i = 0; i < count; i++)
+			{
+				int dx = directions[i][0];
+				int dy = directions[i][1];
+
+				int next = Jump(x, y, dx, dy, goal);
+
+				if (next == -1 || m_States[next] == State::CLOSED)
+					continue;
+
+				int steps = std::max(std::abs(next % m_MapSize.x - x), std::abs(next / m_MapSize.x - y));
+				float step = (dx != 0 && dy != 0) ? diagonalCost : 1.0f;
+
+				Relax(next, current, m_Costs[current] + (float)steps * step, heuristic);
+			}
+		}
+
+		// Links the nodes between the jump points of the path
+		if (m_States[goal] == State::CLOSED)
+		{
+			for (int node = goal; m_Parents[node] != -1;)
+			{
+				int parent = m_Parents[node];
+
+				int x = node % m_MapSize.x;
+				int y = node / m_MapSize.x;
+
+				int dx = (parent % m_MapSize.x > x) - (parent % m_MapSize.x < x);
+				int dy = (parent / m_MapSize.x > y) - (parent / m_MapSize.x < y);
+
+				float step = (dx != 0 && dy != 0) ? diagonalCost : 1.0f;
+
+				for (int between = node; between != parent;)
+				{
+					int next = between + dy * m_MapSize.x + dx;
+
+					if (next != parent)
+					{
+						if (m_Costs[next] == INFINITY)
+							m_Touched.push_back(next);
+
+						m_Costs[next] = m_Costs[between] - step;
+					}
+
+					m_Parents[between] = next;
+					between = next;
+				}
+
+				node = parent;
+			}
+		}
+
+		StoreResults();
+	}
+
+	void PathFinder::FindPathIncremental(float (*dist)(Node*, Node*), float (*heuristic)(Node*, Node*))
+	{
+		if (!m_Start || !m_Goal)
+			return;
+
+		int start = int(m_Start - m_Nodes.data());
+		int goal = int(m_Goal - m_Nodes.data());
+
+		IncrementalSearch& search = m_Incremental;
+
+		// The marks of the last call are taken off
+		for (int index : search.visited)
+			m_Nodes[index].isVisited = false;
+
+		for (int index : search.path)
+		{
+			m_Nodes[index].localGoal = INFINITY;
+			m_Nodes[index].parent = nullptr;
+		}
+
+		search.visited.clear();
+		search.path.clear();
+
+		if (goal != search.goal || dist != search.dist || heuristic != search.heuristic)
+		{
+			size_t count = m_Nodes.size();
+
+			search.goal = goal;
+			search.lastStart = start;
+			search.dist = dist;
+			search.heuristic = heuristic;
+
+			search.g.assign(count, INFINITY);
+			search.rhs.assign(count, INFINITY);
+			search.open.Resize(count, { INFINITY, INFINITY });
+
+			search.keyModifier = 0.0f;
+			search.changed.clear();
+
+			search.rhs[goal] = 0.0f;
+			search.open.Push(goal, GetIncrementalKey(goal));
+		}
+		else
+		{
+			search.keyModifier += heuristic(&m_Nodes[search.lastStart], m_Start);
+			search.lastStart = start;
+
+			// The costs of the edges around a changed node are different now
+			for (int index : search.changed)
+			{
+				UpdateIncremental(index);
+				ForEachNeighbour(index, [this](int next) { UpdateIncremental(next); });
+			}
+
+			search.changed.clear();
+		}
 
-		std::list<Node*> nodesToTest;
-		nodesToTest.push_back(current);
+		ComputeIncremental(start);
 
-		while (!nodesToTest.empty() && current != m_Goal)
+		// The search can stop before g of the start is set, rhs has the cost then
+		if (search.rhs[start] == INFINITY)
+			return;
+
+		// Every step goes to the neighbour with the cheapest way to the goal
+		search.path.push_back(start);
+		m_Nodes[start].localGoal = 0.0f;
+
+		for (int current = start; current != goal && search.path.size() <= m_Nodes.size();)
 		{
-			nodesToTest.sort(
-				[](const Node* lhs, const Node* rhs) {
-					return lhs->globalGoal < rhs->globalGoal;
+			int best = -1;
+			float bestCost = INFINITY;
+
+			ForEachNeighbour(current, [&](int next)
+				{
+					float cost = GetEdgeCost(current, next) + search.g[next];
+
+					if (cost < bestCost)
+					{
+						best = next;
+						bestCost = cost;
+					}
 				});
 
-			while (!nodesToTest.empty() && nodesToTest.front()->isVisited)
-				nodesToTest.pop_front();
+			if (best == -1)
+				break;
+
+			m_Nodes[best].localGoal = m_Nodes[current].localGoal + GetEdgeCost(current, best);
+			m_Nodes[best].parent = &m_Nodes[current];
+
+			search.path.push_back(best);
+			current = best;
+		}
+	}
+
+	void PathFinder::FindPathHierarchical(float (*dist)(Node*, Node*), float (*heuristic)(Node*, Node*), int clusterSize)
+	{
+		if (!m_Start || !m_Goal || clusterSize <= 0)
+			return;
+
+		if (clusterSize != m_ClusterSize || dist != m_ClusterDist)
+			BuildClusters(clusterSize, dist);
+
+		int start = int(m_Start - m_Nodes.data());
+		int goal = int(m_Goal - m_Nodes.data());
+
+		Cluster& startCluster = GetCluster(start);
+		Cluster& goalCluster = GetCluster(goal);
+
+		// Going through the entrances makes the short paths much longer so the start and the goal
+		// in the same or in neighbouring clusters are joined by a search over only these clusters first
+		if (std::abs(startCluster.pos.x - goalCluster.pos.x) <= m_ClusterSize && std::abs(startCluster.pos.y - goalCluster.pos.y) <= m_ClusterSize)
+		{
+			Cluster window{};
+			window.pos = startCluster.pos.min(goalCluster.pos);
+			window.size = (startCluster.pos + startCluster.size).max(goalCluster.pos + goalCluster.size) - window.pos;
+
+			SearchCluster(window, start, false, { goal }, m_ClusterCosts, m_ClusterParents);
+
+			if (m_ClusterCosts[GetClusterPosition(window, goal)] != INFINITY)
+			{
+				for (int node = goal; node != -1; node = m_Parents[node])
+				{
+					m_Touched.push_back(node);
+
+					m_Costs[node] = m_ClusterCosts[GetClusterPosition(window, node)];
+					m_Parents[node] = m_ClusterParents[GetClusterPosition(window, node)];
+				}
+
+				m_States[start] = State::CLOSED;
+				m_States[goal] = State::CLOSED;
+
+				StoreResults();
+				return;
+			}
+		}
+
+		UpdateCluster(startCluster);
+		UpdateCluster(goalCluster);
+
+		std::vector<float>& costs = m_ClusterCosts;
+		std::vector<int>& parents = m_ClusterParents;
+
+		// The start and the goal are joined to the entrances of their clusters only for this search
+		std::vector<ClusterEdge> startEdges;
+		std::vector<ClusterEdge> goalEdges(goalCluster.nodes.size());
+
+		std::vector<int> targets = startCluster.nodes;
+
+		if (&startCluster == &goalCluster)
+			targets.push_back(goal);
+
+		SearchCluster(startCluster, start, false, targets, costs, parents);
 
-			if (nodesToTest.empty()) break;
+		for (int target : targets)
+		{
+			float cost = costs[GetClusterPosition(startCluster, target)];
+
+			if (cost == INFINITY || target == start)
+				continue;
+
+			ClusterEdge edge{ target, cost, {} };
+
+			for (int node = target; node != start; node = parents[GetClusterPosition(startCluster, node)])
+				edge.path.push_back(node);
+
+			std::reverse(edge.path.begin(), edge.path.end());
+			startEdges.push_back(std::move(edge));
+		}
+
+		SearchCluster(goalCluster, goal, true, goalCluster.nodes, costs, parents);
+
+		for (size_t i = 0; i < goalCluster.nodes.size(); i++)
+		{
+			int node = goalCluster.nodes[i];
+
+			goalEdges[i] = { goal, costs[GetClusterPosition(goalCluster, node)], {} };
+
+			if (goalEdges[i].cost == INFINITY || node == goal)
+				continue;
+
+			for (node = parents[GetClusterPosition(goalCluster, node)]; node != -1; node = parents[GetClusterPosition(goalCluster, node)])
+				goalEdges[i].path.push_back(node);
+		}
 
-			current = nodesToTest.front();
-			current->isVisited = true;
+		// The path of the edge that each node was reached by
+		std::unordered_map<int, const std::vector<int>*> edgePaths;
 
-			for (auto& n : current->neighbours)
+		auto follow = [&](int current, const ClusterEdge& edge)
 			{
-				if (!n->isVisited && !n->isObstacle)
-					nodesToTest.push_back(n);
+				if (edge.cost == INFINITY || m_States[edge.to] == State::CLOSED)
+					return;
 
-				float newGoal = current->localGoal + dist(current, n);
+				float cost = m_Costs[current] + edge.cost;
 
-				if (newGoal < n->localGoal)
+				if (cost < m_Costs[edge.to])
 				{
-					n->parent = current;
-					n->localGoal = newGoal;
-					n->globalGoal = n->localGoal + heuristic(n, m_Goal);
+					edgePaths[edge.to] = &edge.path;
+					Relax(edge.to, current, cost, heuristic);
 				}
+			};
+
+		m_Touched.push_back(start);
+		m_Costs[start] = 0.0f;
+		m_States[start] = State::OPEN;
+		m_Open.Push(start, heuristic(m_Start, m_Goal));
+
+		while (!m_Open.IsEmpty())
+		{
+			int current = m_Open.Pop();
+			m_States[current] = State::CLOSED;
+
+			if (current == goal)
+				break;
+
+			if (current == start)
+			{
+				for (const ClusterEdge& edge : startEdges)
+					follow(current, edge);
 			}
+
+			// Only the clusters that the search reaches are built
+			Cluster& cluster = GetCluster(current);
+			UpdateCluster(cluster);
+
+			int entrance = m_EntranceIndices[current];
+
+			if (entrance == -1)
+				continue;
+
+			SearchEntrance(cluster, entrance);
+
+			for (const ClusterEdge& edge : cluster.edges[entrance])
+				follow(current, edge);
+
+			if (&cluster == &goalCluster)
+				follow(current, goalEdges[entrance]);
 		}
+
+		// The nodes between the entrances are filled in from the paths of the edges
+		if (m_States[goal] == State::CLOSED)
+		{
+			for (int node = goal; node != start;)
+			{
+				int parent = m_Parents[node];
+
+				int previous = parent;
+				float cost = m_Costs[parent];
+
+				for (int next : *edgePaths[node])
+				{
+					// The start keeps no parent so the path can't loop back onto it
+					if (next == start)
+					{
+						previous = next;
+						continue;
+					}
+
+					if (next != node)
+					{
+						if (m_Costs[next] == INFINITY)
+							m_Touched.push_back(next);
+
+						cost += dist(&m_Nodes[previous], &m_Nodes[next]);
+						m_Costs[next] = cost;
+					}
+
+					m_Parents[next] = previous;
+					previous = next;
+				}
+
+				node = parent;
+			}
+		}
+
+		StoreResults();
+	}
+
+	void PathFinder::Relax(int index, int parent, float cost, float (*heuristic)(Node*, Node*))
+	{
+		if (cost >= m_Costs[index])
+			return;
+
+		// A node is remembered the first time it gets a cost
+		if (m_Costs[index] == INFINITY)
+			m_Touched.push_back(index);
+
+		m_Costs[index] = cost;
+		m_Parents[index] = parent;
+
+		float priority = cost + heuristic(&m_Nodes[index], m_Goal);
+
+		if (m_States[index] == State::OPEN)
+			m_Open.Update(index, priority);
+		else
+		{
+			m_States[index] = State::OPEN;
+			m_Open.Push(index, priority);
+		}
+	}
+
+	bool PathFinder::SetObstacle(const def::vi2d& pos, bool isObstacle)
+	{
+		if (pos.x < 0 || pos.y < 0 || pos.x >= m_MapSize.x || pos.y >= m_MapSize.y)
+			return false;
+
+		int index = pos.y * m_MapSize.x + pos.x;
+		m_Nodes[index].isObstacle = isObstacle;
+
+		if (IsWalkable(pos.x, pos.y) == isObstacle)
+		{
+			SetWalkable(pos.x, pos.y, !isObstacle);
+			OnObstacleChanged(index);
+		}
+
+		return true;
+	}
+
+	void PathFinder::UpdateObstacles()
+	{
+		int rowWords = (m_MapSize.x + 2 + 63) / 64;
+		int columnWords = (m_MapSize.y + 2 + 63) / 64;
+
+		// The bits are made once for the map, after that only the nodes that changed are written
+		if (m_RowBits.size() != size_t(rowWords * (m_MapSize.y + 2)))
+		{
+			m_RowWords = rowWords;
+			m_ColumnWords = columnWords;
+
+			m_RowBits.assign(m_RowWords * (m_MapSize.y + 2), 0);
+			m_ColumnBits.assign(m_ColumnWords * (m_MapSize.x + 2), 0);
+		}
+
+		for (int y = 0; y < m_MapSize.y; y++)
+			for (int x = 0; x < m_MapSize.x; x++)
+			{
+				int index = y * m_MapSize.x + x;
+				bool isWalkable = !m_Nodes[index].isObstacle;
+
+				if (IsWalkable(x, y) != isWalkable)
+				{
+					SetWalkable(x, y, isWalkable);
+					OnObstacleChanged(index);
+				}
+			}
+	}
+
+	void PathFinder::OnObstacleChanged(int index)
+	{
+		if (m_Incremental.goal != -1)
+			m_Incremental.changed.push_back(index);
+
+		if (m_ClusterSize == 0)
+			return;
+
+		int x = index % m_MapSize.x;
+		int y = index / m_MapSize.x;
+
+		int clusterX = x / m_ClusterSize;
+		int clusterY = y / m_ClusterSize;
+
+		Cluster& cluster = m_Clusters[clusterY * m_ClusterCount.x + clusterX];
+
+		bool isLeft = x == cluster.pos.x;
+		bool isTop = y == cluster.pos.y;
+		bool isRight = x == cluster.pos.x + cluster.size.x - 1;
+		bool isBottom = y == cluster.pos.y + cluster.size.y - 1;
+
+		// A cluster finds the entrances on its right and bottom borders and the diagonal ones
+		// into the corners below it, so the clusters that can cross into the node or next to it find them again
+		InvalidateCluster(clusterX, clusterY, isRight || isBottom);
+
+		if (isRight && isBottom) InvalidateCluster(clusterX + 1, clusterY, true);
+		if (isLeft) InvalidateCluster(clusterX - 1, clusterY, true);
+		if (isTop) InvalidateCluster(clusterX, clusterY - 1, true);
+		if (isLeft && isTop) InvalidateCluster(clusterX - 1, clusterY - 1, true);
+		if (isRight && isTop) InvalidateCluster(clusterX + 1, clusterY - 1, true);
+	}
+
+	bool PathFinder::IsWalkable(int x, int y) const
+	{
+		x++; y++;
+		return (m_RowBits[y * m_RowWords + x / 64] >> (x % 64)) & 1;
+	}
+
+	void PathFinder::SetWalkable(int x, int y, bool isWalkable)
+	{
+		x++; y++;
+
+		uint64_t& row = m_RowBits[y * m_RowWords + x / 64];
+		uint64_t& column = m_ColumnBits[x * m_ColumnWords + y / 64];
+
+		if (isWalkable)
+		{
+			row |= 1ull << (x % 64);
+			column |= 1ull << (y % 64);
+		}
+		else
+		{
+			row &= ~(1ull << (x % 64));
+			column &= ~(1ull << (y % 64));
+		}
+	}
+
+	int PathFinder::Jump(int x, int y, int dx, int dy, int goal) const
+	{
+		int goalX = goal % m_MapSize.x;
+		int goalY = goal / m_MapSize.x;
+
+		// The straight moves skip 64 nodes at once
+		if (dy == 0)
+		{
+			const uint64_t* row = &m_RowBits[(y + 1) * m_RowWords];
+			int stop = Scan(row, row - m_RowWords, row + m_RowWords, m_RowWords, x + 1, dx) - 1;
+
+			if (goalY == y && (goalX - x) * dx > 0 && (stop - goalX) * dx >= 0)
+				return goal;
+
+			return IsWalkable(stop, y) ? y * m_MapSize.x + stop : -1;
+		}
+
+		if (dx == 0)
+		{
+			const uint64_t* column = &m_ColumnBits[(x + 1) * m_ColumnWords];
+			int stop = Scan(column, column - m_ColumnWords, column + m_ColumnWords, m_ColumnWords, y + 1, dy) - 1;
+
+			if (goalX == x && (goalY - y) * dy > 0 && (stop - goalY) * dy >= 0)
+				return goal;
+
+			return IsWalkable(x, stop) ? stop * m_MapSize.x + x : -1;
+		}
+
+		while (true)
+		{
+			x += dx;
+			y += dy;
+
+			if (!IsWalkable(x, y))
+				return -1;
+
+			int index = y * m_MapSize.x + x;
+
+			if (index == goal)
+				return index;
+
+			if ((IsWalkable(x - dx, y + dy) && !IsWalkable(x - dx, y)) || (IsWalkable(x + dx, y - dy) && !IsWalkable(x, y - dy)))
+				return index;
+
+			// A diagonal move stops where a straight move from it would find a jump point
+			if (Jump(x, y, dx, 0, goal) != -1 || Jump(x, y, 0, dy, goal) != -1)
+				return index;
+		}
+	}
+
+	int PathFinder::Scan(const uint64_t* line, const uint64_t* side0, const uint64_t* side1, int words, int from, int dir)
+	{
+		// The bit of a side at a position is moved onto the position before it in the direction
+		auto ahead = [words, dir](const uint64_t* side, int word)
+			{
+				if (dir > 0)
+					return (side[word] >> 1) | (word + 1 < words ? side[word + 1] << 63 : 0);
+
+				return (side[word] << 1) | (word > 0 ? side[word - 1] >> 63 : 0);
+			};
+
+		auto stops = [&](int word)
+			{
+				return ~line[word] | (ahead(side0, word) & ~side0[word]) | (ahead(side1, word) & ~side1[word]);
+			};
+
+		int word = from / 64;
+		int bit = from % 64;
+
+		// The border is blocked so there is always a stop
+		if (dir > 0)
+		{
+			uint64_t found = stops(word) & (bit == 63 ? 0 : ~0ull << (bit + 1));
+
+			while (found == 0)
+				found = stops(++word);
+
+			return word * 64 + std::countr_zero(found);
+		}
+
+		uint64_t found = stops(word) & ((1ull << bit) - 1);
+
+		while (found == 0)
+			found = stops(--word);
+
+		return word * 64 + 63 - std::countl_zero(found);
+	}
+
+	template <class Func>
+	void PathFinder::ForEachNeighbour(int index, Func&& func) const
+	{
+		int x = index % m_MapSize.x;
+		int y = index / m_MapSize.x;
+
+		bool topFits = y > 0;
+		bool bottomFits = y < m_MapSize.y - 1;
+
+		bool leftFits = x > 0;
+		bool rightFits = x < m_MapSize.x - 1;
+
+		if (topFits) func(index - m_MapSize.x);
+		if (bottomFits) func(index + m_MapSize.x);
+		if (leftFits) func(index - 1);
+		if (rightFits) func(index + 1);
+
+		if (topFits && leftFits) func(index - m_MapSize.x - 1);
+		if (bottomFits && rightFits) func(index + m_MapSize.x + 1);
+		if (leftFits && bottomFits) func(index + m_MapSize.x - 1);
+		if (rightFits && topFits) func(index - m_MapSize.x + 1);
+	}
+
+	void PathFinder::StoreResults()
+	{
+		for (int index : m_Touched)
+		{
+			Node& node = m_Nodes[index];
+
+			node.isVisited = m_States[index] == State::CLOSED;
+			node.localGoal = m_Costs[index];
+			node.globalGoal = m_Open.keys[index];
+			node.parent = m_Parents[index] == -1 ? nullptr : &m_Nodes[m_Parents[index]];
+
+			m_Costs[index] = INFINITY;
+			m_Parents[index] = -1;
+			m_States[index] = State::UNSEEN;
+
+			m_Open.keys[index] = INFINITY;
+		}
+
+		m_Touched.clear();
+		m_Open.Clear();
+	}
+
+	float PathFinder::GetEdgeCost(int from, int to) const
+	{
+		int fromX = from % m_MapSize.x, fromY = from / m_MapSize.x;
+		int toX = to % m_MapSize.x, toY = to / m_MapSize.x;
+
+		if (!IsWalkable(fromX, fromY) || !IsWalkable(toX, toY))
+			return INFINITY;
+
+		Node* nodes = const_cast<Node*>(m_Nodes.data());
+		return m_Incremental.dist(&nodes[from], &nodes[to]);
+	}
+
+	std::pair<float, float> PathFinder::GetIncrementalKey(int index) const
+	{
+		float cost = std::min(m_Incremental.g[index], m_Incremental.rhs[index]);
+		return { cost + m_Incremental.heuristic(const_cast<Node*>(&m_Nodes[index]), m_Start) + m_Incremental.keyModifier, cost };
+	}
+
+	void PathFinder::UpdateIncremental(int index)
+	{
+		IncrementalSearch& search = m_Incremental;
+
+		if (index != search.goal)
+		{
+			float rhs = INFINITY;
+
+			ForEachNeighbour(index, [&](int next)
+				{ rhs = std::min(rhs, GetEdgeCost(index, next) + search.g[next]); });
+
+			search.rhs[index] = rhs;
+		}
+
+		UpdateIncrementalKey(index);
+	}
+
+	void PathFinder::UpdateIncrementalKey(int index)
+	{
+		IncrementalSearch& search = m_Incremental;
+
+		bool isConsistent = search.g[index] == search.rhs[index];
+
+		if (search.open.Contains(index))
+		{
+			if (isConsistent)
+				search.open.Remove(index);
+			else
+				search.open.Update(index, GetIncrementalKey(index));
+		}
+		else if (!isConsistent)
+			search.open.Push(index, GetIncrementalKey(index));
+	}
+
+	void PathFinder::ComputeIncremental(int start)
+	{
+		IncrementalSearch& search = m_Incremental;
+
+		// The costs are sums of floats so a node that ties with the start on a straight line can come out
+		// a little more expensive, the ties are searched too or the start may keep a path through it
+		auto isBeforeStart = [&](const std::pair<float, float>& key)
+			{
+				float startKey = GetIncrementalKey(start).first;
+				return key.first <= startKey + 1e-4f * std::max(1.0f, std::abs(startKey));
+			};
+
+		while (!search.open.IsEmpty() && (isBeforeStart(search.open.TopKey()) || search.rhs[start] > search.g[start]))
+		{
+			int current = search.open.Top();
+
+			auto oldKey = search.open.TopKey();
+			auto newKey = GetIncrementalKey(current);
+
+			if (oldKey < newKey)
+			{
+				// The key was made for an older start
+				search.open.Update(current, newKey);
+				continue;
+			}
+
+			search.visited.push_back(current);
+			m_Nodes[current].isVisited = true;
+
+			if (search.g[current] > search.rhs[current])
+			{
+				search.g[current] = search.rhs[current];
+				search.open.Remove(current);
+
+				ForEachNeighbour(current, [&](int next)
+					{
+						if (next == search.goal)
+							return;
+
+						float rhs = GetEdgeCost(next, current) + search.g[current];
+
+						if (rhs < search.rhs[next])
+						{
+							search.rhs[next] = rhs;
+							UpdateIncrementalKey(next);
+						}
+					});
+			}
+			else
+			{
+				// The node got more expensive so it and everything that went through it look again
+				search.g[current] = INFINITY;
+
+				UpdateIncremental(current);
+				ForEachNeighbour(current, [this](int next) { UpdateIncremental(next); });
+			}
+		}
+	}
+
+	void PathFinder::BuildClusters(int clusterSize, float (*dist)(Node*, Node*))
+	{
+		m_ClusterSize = clusterSize;
+		m_ClusterDist = dist;
+
+		m_ClusterCount = (m_MapSize + clusterSize - 1) / clusterSize;
+
+		m_Clusters.assign(m_ClusterCount.x * m_ClusterCount.y, Cluster());
+
+		m_EntranceIndices.assign(m_Nodes.size(), -1);
+
+		for (int y = 0; y < m_ClusterCount.y; y++)
+			for (int x = 0; x < m_ClusterCount.x; x++)
+			{
+				Cluster& cluster = m_Clusters[y * m_ClusterCount.x + x];
+
+				cluster.pos = def::vi2d(x, y) * clusterSize;
+				cluster.size.x = std::min(clusterSize, m_MapSize.x - cluster.pos.x);
+				cluster.size.y = std::min(clusterSize, m_MapSize.y - cluster.pos.y);
+
+				cluster.areEntrancesValid = false;
+				cluster.areEdgesValid = false;
+			}
+	}
+
+	void PathFinder::UpdateCluster(Cluster& cluster)
+	{
+		if (cluster.areEdgesValid)
+			return;
+
+		int clusterX = cluster.pos.x / m_ClusterSize;
+		int clusterY = cluster.pos.y / m_ClusterSize;
+
+		// The cluster and the ones on the left and above find the entrances that cross into it
+		for (int y = clusterY - 1; y <= clusterY; y++)
+			for (int x = clusterX - 1; x <= clusterX + 1; x++)
+			{
+				if (x < 0 || y < 0 || x >= m_ClusterCount.x || (y == clusterY && x > clusterX))
+					continue;
+
+				Cluster& other = m_Clusters[y * m_ClusterCount.x + x];
+
+				if (!other.areEntrancesValid)
+					FindEntrances(other);
+			}
+
+		FindClusterEdges(cluster);
+	}
+
+	void PathFinder::InvalidateCluster(int x, int y, bool entrances)
+	{
+		if (x < 0 || y < 0 || x >= m_ClusterCount.x || y >= m_ClusterCount.y)
+			return;
+
+		Cluster& cluster = m_Clusters[y * m_ClusterCount.x + x];
+		cluster.areEdgesValid = false;
+
+		if (entrances)
+		{
+			cluster.areEntrancesValid = false;
+
+			// The clusters across the borders get new nodes from the entrances
+			InvalidateCluster(x + 1, y, false);
+			InvalidateCluster(x - 1, y + 1, false);
+			InvalidateCluster(x, y + 1, false);
+			InvalidateCluster(x + 1, y + 1, false);
+		}
+	}
+
+	PathFinder::Cluster& PathFinder::GetCluster(int index)
+	{
+		int x = index % m_MapSize.x / m_ClusterSize;
+		int y = index / m_MapSize.x / m_ClusterSize;
+
+		return m_Clusters[y * m_ClusterCount.x + x];
+	}
+
+	int PathFinder::GetClusterPosition(const Cluster& cluster, int index) const
+	{
+		return (index / m_MapSize.x - cluster.pos.y) * cluster.size.x + index % m_MapSize.x - cluster.pos.x;
+	}
+
+	void PathFinder::FindEntrances(Cluster& cluster)
+	{
+		// Every run of free nodes on both sides of a border gets an entrance in the middle,
+		// the long ones get two at their ends
+		auto find = [this](std::vector<std::pair<int, int>>& entrances, def::vi2d pos, def::vi2d step, def::vi2d across, int length)
+			{
+				int runStart = -1;
+
+				for (int i = 0; i <= length; i++)
+				{
+					def::vi2d inside = pos + step * i;
+					def::vi2d outside = inside + across;
+
+					bool isOpen = i < length && IsWalkable(inside.x, inside.y) && IsWalkable(outside.x, outside.y);
+
+					if (isOpen && runStart == -1)
+						runStart = i;
+
+					if (isOpen || runStart == -1)
+						continue;
+
+					auto add = [&](int at)
+						{
+							def::vi2d node = pos + step * at;
+							entrances.push_back({ node.y * m_MapSize.x + node.x, (node.y + across.y) * m_MapSize.x + node.x + across.x });
+						};
+
+					if (i - runStart < 6)
+						add((runStart + i - 1) / 2);
+					else
+					{
+						add(runStart);
+						add(i - 1);
+					}
+
+					runStart = -1;
+				}
+			};
+
+		// A diagonal step goes around a corner through one of the two nodes next to both ends,
+		// that makes two straight crossings so only the steps between two obstacles get an entrance
+		auto findDiagonal = [this](std::vector<std::pair<int, int>>& entrances, def::vi2d pos, def::vi2d step, def::vi2d across, int length)
+			{
+				for (int i = 0; i < length; i++)
+				{
+					def::vi2d inside = pos + step * i;
+					def::vi2d outside = inside + across;
+
+					// The nodes outside of the map are never walkable
+					if (IsWalkable(inside.x, inside.y) && IsWalkable(outside.x, outside.y) &&
+						!IsWalkable(outside.x, inside.y) && !IsWalkable(inside.x, outside.y))
+						entrances.push_back({ inside.y * m_MapSize.x + inside.x, outside.y * m_MapSize.x + outside.x });
+				}
+			};
+
+		def::vi2d end = cluster.pos + cluster.size - 1;
+
+		cluster.rightEntrances.clear();
+		cluster.bottomEntrances.clear();
+
+		// The step from the bottom right node into the corner belongs to the right border
+		// and the one into the top right corner belongs to the bottom border of the cluster there
+		if (end.x + 1 < m_MapSize.x)
+		{
+			find(cluster.rightEntrances, { end.x, cluster.pos.y }, { 0, 1 }, { 1, 0 }, cluster.size.y);
+			findDiagonal(cluster.rightEntrances, { end.x, cluster.pos.y + 1 }, { 0, 1 }, { 1, -1 }, cluster.size.y - 1);
+			findDiagonal(cluster.rightEntrances, { end.x, cluster.pos.y }, { 0, 1 }, { 1, 1 }, cluster.size.y);
+		}
+
+		if (end.y + 1 < m_MapSize.y)
+		{
+			find(cluster.bottomEntrances, { cluster.pos.x, end.y }, { 1, 0 }, { 0, 1 }, cluster.size.x);
+			findDiagonal(cluster.bottomEntrances, { cluster.pos.x, end.y }, { 1, 0 }, { -1, 1 }, cluster.size.x);
+			findDiagonal(cluster.bottomEntrances, { cluster.pos.x, end.y }, { 1, 0 }, { 1, 1 }, cluster.size.x - 1);
+		}
+
+		cluster.areEntrancesValid = true;
+	}
+
+	void PathFinder::FindClusterEdges(Cluster& cluster)
+	{
+		for (int node : cluster.nodes)
+			m_EntranceIndices[node] = -1;
+
+		cluster.nodes.clear();
+		cluster.edges.clear();
+		cluster.isSearched.clear();
+
+		int clusterX = cluster.pos.x / m_ClusterSize;
+		int clusterY = cluster.pos.y / m_ClusterSize;
+
+		// The node inside and the one across the border
+		auto add = [&](int node, int across)
+			{
+				if (m_EntranceIndices[node] == -1)
+				{
+					m_EntranceIndices[node] = (int)cluster.nodes.size();
+
+					cluster.nodes.push_back(node);
+					cluster.edges.emplace_back();
+					cluster.isSearched.push_back(false);
+				}
+
+				cluster.edges[m_EntranceIndices[node]].push_back({ across, m_ClusterDist(&m_Nodes[node], &m_Nodes[across]), { across } });
+			};
+
+		for (auto& [inside, outside] : cluster.rightEntrances)
+			add(inside, outside);
+
+		for (auto& [inside, outside] : cluster.bottomEntrances)
+			add(inside, outside);
+
+		// The clusters on the left and above cross into this one, the ones in the corners only diagonally
+		auto addFrom = [&](int x, int y, bool right)
+			{
+				if (x < 0 || y < 0 || x >= m_ClusterCount.x)
+					return;
+
+				const Cluster& other = m_Clusters[y * m_ClusterCount.x + x];
+
+				for (auto& [outside, inside] : right ? other.rightEntrances : other.bottomEntrances)
+				{
+					if (&GetCluster(inside) == &cluster)
+						add(inside, outside);
+				}
+			};
+
+		addFrom(clusterX - 1, clusterY, true);
+		addFrom(clusterX, clusterY - 1, false);
+		addFrom(clusterX - 1, clusterY - 1, true);
+		addFrom(clusterX + 1, clusterY - 1, false);
+
+		cluster.areEdgesValid = true;
+	}
+
+	void PathFinder::SearchEntrance(Cluster& cluster, int entrance)
+	{
+		if (cluster.isSearched[entrance])
+			return;
+
+		int from = cluster.nodes[entrance];
+		SearchCluster(cluster, from, false, cluster.nodes, m_ClusterCosts, m_ClusterParents);
+
+		for (int to : cluster.nodes)
+		{
+			float cost = m_ClusterCosts[GetClusterPosition(cluster, to)];
+
+			if (to == from || cost == INFINITY)
+				continue;
+
+			ClusterEdge edge{ to, cost, {} };
+
+			for (int node = to; node != from; node = m_ClusterParents[GetClusterPosition(cluster, node)])
+				edge.path.push_back(node);
+
+			std::reverse(edge.path.begin(), edge.path.end());
+			cluster.edges[entrance].push_back(std::move(edge));
+		}
+
+		cluster.isSearched[entrance] = true;
+	}
+
+	void PathFinder::SearchCluster(const Cluster& cluster, int from, bool backward, const std::vector<int>& targets, std::vector<float>& costs, std::vector<int>& parents) const
+	{
+		int area = cluster.size.x * cluster.size.y;
+
+		costs.assign(area, INFINITY);
+		parents.assign(area, -1);
+
+		if (!IsWalkable(from % m_MapSize.x, from / m_MapSize.x))
+			return;
+
+		Node* nodes = const_cast<Node*>(m_Nodes.data());
+
+		m_ClusterTargets.assign(area, false);
+		int remaining = 0;
+
+		for (int target : targets)
+		{
+			int position = GetClusterPosition(cluster, target);
+
+			if (!m_ClusterTargets[position])
+			{
+				m_ClusterTargets[position] = true;
+				remaining++;
+			}
+		}
+
+		// The heap keeps the positions in the cluster so the neighbours are found without dividing
+		std::vector<std::pair<float, int>>& open = m_ClusterOpen;
+		open.clear();
+		auto later = [](const std::pair<float, int>& lhs, const std::pair<float, int>& rhs) { return lhs.first > rhs.first; };
+
+		costs[GetClusterPosition(cluster, from)] = 0.0f;
+		open.push_back({ 0.0f, GetClusterPosition(cluster, from) });
+
+		while (!open.empty())
+		{
+			std::pop_heap(open.begin(), open.end(), later);
+			auto [cost, position] = open.back();
+			open.pop_back();
+
+			if (cost > costs[position])
+				continue;
+
+			if (m_ClusterTargets[position] && --remaining == 0)
+				break;
+
+			int x = position % cluster.size.x;
+			int y = position / cluster.size.x;
+
+			int current = (cluster.pos.y + y) * m_MapSize.x + cluster.pos.x + x;
+
+			for (int dy = -1; dy <= 1; dy++)
+				for (int dx = -1; dx <= 1; dx++)
+				{
+					int nextX = x + dx;
+					int nextY = y + dy;
+
+					if ((dx == 0 && dy == 0) || nextX < 0 || nextY < 0 || nextX >= cluster.size.x || nextY >= cluster.size.y ||
+						!IsWalkable(cluster.pos.x + nextX, cluster.pos.y + nextY))
+						continue;
+
+					int next = current + dy * m_MapSize.x + dx;
+					int nextPosition = nextY * cluster.size.x + nextX;
+
+					float nextCost = cost + (backward ? m_ClusterDist(&nodes[next], &nodes[current]) : m_ClusterDist(&nodes[current], &nodes[next]));
+
+					if (nextCost < costs[nextPosition])
+					{
+						costs[nextPosition] = nextCost;
+						parents[nextPosition] = current;
+
+						open.push_back({ nextCost, nextPosition });
+						std::push_heap(open.begin(), open.end(), later);
+					}
+				}
+		}
+	}
+
+	template <class Key>
+	void PathFinder::IndexedHeap<Key>::Resize(size_t count, const Key& key)
+	{
+		nodes.clear();
+
+		positions.assign(count, -1);
+		keys.assign(count, key);
+	}
+
+	template <class Key>
+	bool PathFinder::IndexedHeap<Key>::IsEmpty() const
+	{
+		return nodes.empty();
+	}
+
+	template <class Key>
+	bool PathFinder::IndexedHeap<Key>::Contains(int node) const
+	{
+		return positions[node] != -1;
+	}
+
+	template <class Key>
+	int PathFinder::IndexedHeap<Key>::Top() const
+	{
+		return nodes.front();
+	}
+
+	template <class Key>
+	const Key& PathFinder::IndexedHeap<Key>::TopKey() const
+	{
+		return keys[nodes.front()];
+	}
+
+	template <class Key>
+	void PathFinder::IndexedHeap<Key>::Push(int node, const Key& key)
+	{
+		keys[node] = key;
+		positions[node] = (int)nodes.size();
+
+		nodes.push_back(node);
+		SiftUp((int)nodes.size() - 1);
+	}
+
+	template <class Key>
+	int PathFinder::IndexedHeap<Key>::Pop()
+	{
+		int top = nodes.front();
+		Remove(top);
+		return top;
+	}
+
+	template <class Key>
+	void PathFinder::IndexedHeap<Key>::Update(int node, const Key& key)
+	{
+		keys[node] = key;
+
+		SiftUp(positions[node]);
+		SiftDown(positions[node]);
+	}
+
+	template <class Key>
+	void PathFinder::IndexedHeap<Key>::Remove(int node)
+	{
+		int position = positions[node];
+		positions[node] = -1;
+
+		int last = nodes.back();
+		nodes.pop_back();
+
+		if (last == node)
+			return;
+
+		// The last node takes the place and goes wherever its key belongs
+		nodes[position] = last;
+		positions[last] = position;
+
+		SiftUp(position);
+		SiftDown(positions[last]);
+	}
+
+	template <class Key>
+	void PathFinder::IndexedHeap<Key>::Clear()
+	{
+		for (int node : nodes)
+			positions[node] = -1;
+
+		nodes.clear();
+	}
+
+	template <class Key>
+	void PathFinder::IndexedHeap<Key>::SiftUp(int position)
+	{
+		int node = nodes[position];
+
+		while (position > 0)
+		{
+			int parent = (position - 1) / 2;
+
+			if (!(keys[node] < keys[nodes[parent]]))
+				break;
+
+			nodes[position] = nodes[parent];
+			positions[nodes[position]] = position;
+
+			position = parent;
+		}
+
+		nodes[position] = node;
+		positions[node] = position;
+	}
+
+	template <class Key>
+	void PathFinder::IndexedHeap<Key>::SiftDown(int position)
+	{
+		int node = nodes[position];
+		int count = (int)nodes.size();
+
+		while (true)
+		{
+			int child = position * 2 + 1;
+
+			if (child >= count)
+				break;
+
+			if (child + 1 < count && keys[nodes[child + 1]] < keys[nodes[child]])
+				child++;
+
+			if (!(keys[nodes[child]] < keys[node]))
+				break;
+
+			nodes[position] = nodes[child];
+			positions[nodes[position]] = position;
+
+			position = child;
+		}
+
+		nodes[position] = node;
+		positions[node] = position;
+	}
+
+	def::vi2d FlowField::GetMapSize() const
+	{
+		return m_MapSize;
+	}
+
+	def::vi2d FlowField::GetGoal() const
+	{
+		return m_Goal;
+	}
+
+	float FlowField::GetCost(const def::vi2d& pos) const
+	{
+		if (pos.x < 0 || pos.y < 0 || pos.x >= m_MapSize.x || pos.y >= m_MapSize.y)
+			return INFINITY;
+
+		return m_Costs[pos.y * m_MapSize.x + pos.x];
+	}
+
+	def::vi2d FlowField::GetDirection(const def::vi2d& pos) const
+	{
+		if (pos.x < 0 || pos.y < 0 || pos.x >= m_MapSize.x || pos.y >= m_MapSize.y)
+			return { 0, 0 };
+
+		int direction = m_Directions[pos.y * m_MapSize.x + pos.x];
+
+		if (direction == -1)
+			return { 0, 0 };
+
+		return { s_Directions[direction][0], s_Directions[direction][1] };
+	}
+
+	std::vector<def::vi2d> FlowField::GetPath(const def::vi2d& start) const
+	{
+		std::vector<def::vi2d> path;
+
+		if (GetCost(start) == INFINITY)
+			return path;
+
+		path.push_back(start);
+
+		// The field has no loops but the length is limited anyway
+		for (size_t i = 0; path.back() != m_Goal && i < m_Costs.size(); i++)
+			path.push_back(path.back() + GetDirection(path.back()));
+
+		return path;
+	}
+
+	bool PathFinder::BuildFlowField(const def::vi2d& goal, FlowField& field, float (*dist)(Node*, Node*)) const
+	{
+		if (goal.x < 0 || goal.y < 0 || goal.x >= m_MapSize.x || goal.y >= m_MapSize.y)
+			return false;
+
+		size_t count = m_Nodes.size();
+
+		field.m_MapSize = m_MapSize;
+		field.m_Goal = goal;
+
+		field.m_Costs.assign(count, INFINITY);
+		field.m_Directions.assign(count, -1);
+
+		// The callbacks take the nodes as they are in FindPath but they are only read here
+		Node* nodes = const_cast<Node*>(m_Nodes.data());
+
+		// Every query has its own heap, the nodes that are already done are skipped when they come up again
+		std::vector<std::pair<float, int>> open;
+		auto later = [](const std::pair<float, int>& lhs, const std::pair<float, int>& rhs) { return lhs.first > rhs.first; };
+
+		int start = goal.y * m_MapSize.x + goal.x;
+
+		field.m_Costs[start] = 0.0f;
+		open.push_back({ 0.0f, start });
+
+		while (!open.empty())
+		{
+			std::pop_heap(open.begin(), open.end(), later);
+			auto [cost, current] = open.back();
+			open.pop_back();
+
+			if (cost > field.m_Costs[current])
+				continue;
+
+			int x = current % m_MapSize.x;
+			int y = current / m_MapSize.x;
+
+			for (int i = 0; i < 8; i++)
+			{
+				int nextX = x + FlowField::s_Directions[i][0];
+				int nextY = y + FlowField::s_Directions[i][1];
+
+				if (nextX < 0 || nextY < 0 || nextX >= m_MapSize.x || nextY >= m_MapSize.y)
+					continue;
+
+				int next = nextY * m_MapSize.x + nextX;
+
+				if (nodes[next].isObstacle)
+					continue;
+
+				// An agent on the next node steps back onto the current one
+				float nextCost = cost + dist(&nodes[next], &nodes[current]);
+
+				if (nextCost < field.m_Costs[next])
+				{
+					field.m_Costs[next] = nextCost;
+					field.m_Directions[next] = int8_t(i ^ 1);
+
+					open.push_back({ nextCost, next });
+					std::push_heap(open.begin(), open.end(), later);
+				}
+			}
+		}
+
+		return true;
+	}
+
+	void PathFinder::BuildFlowFields(const std::vector<def::vi2d>& goals, std::vector<FlowField>& fields, float (*dist)(Node*, Node*), uint32_t threads) const
+	{
+		fields.resize(goals.size());
+
+#ifndef PLATFORM_EMSCRIPTEN
+		if (threads == 0)
+			threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+		threads = std::min(threads, (uint32_t)goals.size());
+
+		std::atomic<size_t> nextGoal = 0;
+
+		auto work = [&]()
+			{
+				for (size_t i = nextGoal++; i < goals.size(); i = nextGoal++)
+					BuildFlowField(goals[i], fields[i], dist);
+			};
+
+		// The calling thread builds the fields too
+		std::vector<std::thread> workers;
+
+		for (uint32_t i = 1; i < threads; i++)
+			workers.emplace_back(work);
+
+		work();
+
+		for (auto& worker : workers)
+			worker.join();
+#else
+		for (size_t i = 0; i < goals.size(); i++)
+			BuildFlowField(goals[i], fields[i], dist);
+#endif
 	}
 
 #endif
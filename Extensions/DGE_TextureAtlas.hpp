@@ -0,0 +1,291 @@
+#ifndef DGE_TEXTURE_ATLAS_HPP
+#define DGE_TEXTURE_ATLAS_HPP
+
+#pragma region Includes
+
+#include <vector>
+#include <numeric>
+#include <algorithm>
+
+#include "../defGameEngine.hpp"
+
+#pragma endregion
+
+namespace def
+{
+	// A region of an atlas page, draws through DrawPartialTexture
+	struct AtlasSprite
+	{
+		const Texture* texture = nullptr;
+
+		vf2d filePos;
+		vf2d fileSize;
+	};
+
+	class TextureAtlas
+	{
+	public:
+		TextureAtlas(const vi2d& pageSize = { 1024, 1024 }, int padding = 1);
+		~TextureAtlas();
+
+		// The pages are owned by the atlas
+		TextureAtlas(const TextureAtlas&) = delete;
+		TextureAtlas& operator=(const TextureAtlas&) = delete;
+
+	public:
+		// Returns a sprite without texture if it doesn't fit into a page
+		AtlasSprite Add(const Sprite* sprite);
+		AtlasSprite Add(std::string_view fileName);
+
+		// Packs sprites from the tallest to the shortest,
+		// the result is in the same order as the input
+		std::vector<AtlasSprite> Add(const std::vector<const Sprite*>& sprites);
+
+		// Uploads the regions of the pages that were changed since the last call
+		void Update();
+
+		size_t GetPagesCount() const;
+		Graphic* GetPage(size_t index) const;
+
+		vi2d GetPageSize() const;
+
+		void Draw(const vf2d& pos, const AtlasSprite& sprite, const vf2d& scale = { 1.0f, 1.0f }, const Pixel& tint = WHITE);
+		void DrawRotated(const vf2d& pos, const AtlasSprite& sprite, float rotation, const vf2d& center = { 0.0f, 0.0f }, const vf2d& scale = { 1.0f, 1.0f }, const Pixel& tint = WHITE);
+
+	private:
+		struct Segment
+		{
+			int x;
+			int width;
+			int y;
+		};
+
+		struct Page
+		{
+			Graphic* graphic;
+
+			// Top edge of the packed area from left to right
+			std::vector<Segment> skyline;
+		};
+
+		bool FindPosition(const Page& page, const vi2d& size, vi2d& pos, size_t& index) const;
+		void Insert(Page& page, const vi2d& pos, const vi2d& size, size_t index);
+
+		Page& CreatePage();
+
+	private:
+		vi2d m_PageSize;
+		int m_Padding;
+
+		std::vector<Page> m_Pages;
+
+		GameEngine* m_Engine;
+
+	};
+
+#ifdef DGE_TEXTURE_ATLAS
+#undef DGE_TEXTURE_ATLAS
+
+	TextureAtlas::TextureAtlas(const vi2d& pageSize, int padding)
+	{
+		m_PageSize = pageSize;
+		m_Padding = padding;
+		m_Engine = GameEngine::s_Engine;
+	}
+
+	TextureAtlas::~TextureAtlas()
+	{
+		for (auto& page : m_Pages)
+			delete page.graphic;
+	}
+
+	AtlasSprite TextureAtlas::Add(const Sprite* sprite)
+	{
+		vi2d size = sprite->size + m_Padding;
+
+		if (sprite->size.x > m_PageSize.x || sprite->size.y > m_PageSize.y)
+			return {};
+
+		vi2d pos;
+		size_t index;
+
+		auto page = std::find_if(m_Pages.begin(), m_Pages.end(),
+			[&](const Page& p) { return FindPosition(p, size, pos, index); });
+
+		if (page == m_Pages.end())
+		{
+			CreatePage();
+			page = m_Pages.end() - 1;
+
+			FindPosition(*page, size, pos, index);
+		}
+
+		Page& target = *page;
+
+		Insert(target, pos, size, index);
+
+		Sprite* dest = target.graphic->sprite;
+
+		for (int y = 0; y < sprite->size.y; y++)
+		{
+			auto row = sprite->pixels.begin() + y * sprite->size.x;
+			std::copy(row, row + sprite->size.x, dest->pixels.begin() + (pos.y + y) * dest->size.x + pos.x);
+		}
+
+		dest->MarkDirty(pos.x, pos.y, sprite->size.x, sprite->size.y);
+
+		return { target.graphic->texture, pos, sprite->size };
+	}
+
+	AtlasSprite TextureAtlas::Add(std::string_view fileName)
+	{
+		Sprite sprite(fileName);
+		return Add(&sprite);
+	}
+
+	std::vector<AtlasSprite> TextureAtlas::Add(const std::vector<const Sprite*>& sprites)
+	{
+		std::vector<size_t> order(sprites.size());
+		std::iota(order.begin(), order.end(), 0);
+
+		std::stable_sort(order.begin(), order.end(),
+			[&](size_t lhs, size_t rhs) { return sprites[lhs]->size.y > sprites[rhs]->size.y; });
+
+		std::vector<AtlasSprite> result(sprites.size());
+
+		for (size_t i : order)
+			result[i] = Add(sprites[i]);
+
+		return result;
+	}
+
+	void TextureAtlas::Update()
+	{
+		for (auto& page : m_Pages)
+			page.graphic->UpdateTexture();
+	}
+
+	size_t TextureAtlas::GetPagesCount() const
+	{
+		return m_Pages.size();
+	}
+
+	Graphic* TextureAtlas::GetPage(size_t index) const
+	{
+		return m_Pages[index].graphic;
+	}
+
+	vi2d TextureAtlas::GetPageSize() const
+	{
+		return m_PageSize;
+	}
+
+	void TextureAtlas::Draw(const vf2d& pos, const AtlasSprite& sprite, const vf2d& scale, const Pixel& tint)
+	{
+		if (sprite.texture)
+			m_Engine->DrawPartialTexture(pos, sprite.texture, sprite.filePos, sprite.fileSize, scale, tint);
+	}
+
+	void TextureAtlas::DrawRotated(const vf2d& pos, const AtlasSprite& sprite, float rotation, const vf2d& center, const vf2d& scale, const Pixel& tint)
+	{
+		if (sprite.texture)
+			m_Engine->DrawPartialRotatedTexture(pos, sprite.texture, sprite.filePos, sprite.fileSize, rotation, center, scale, tint);
+	}
+
+	bool TextureAtlas::FindPosition(const Page& page, const vi2d& size, vi2d& pos, size_t& index) const
+	{
+		// The padding of the last row and column may fall outside of the page
+		vi2d bounds = m_PageSize + m_Padding;
+
+		int bestBottom = bounds.y + 1;
+		int bestWidth = bounds.x + 1;
+
+		// Bottom-left skyline heuristic: the lowest position wins,
+		// the narrowest segment breaks the ties
+		for (size_t i = 0; i < page.skyline.size(); i++)
+		{
+			int x = page.skyline[i].x;
+
+			if (x + size.x > bounds.x)
+				break;
+
+			int y = 0;
+			int widthLeft = size.x;
+
+			for (size_t j = i; widthLeft > 0; j++)
+			{
+				y = std::max(y, page.skyline[j].y);
+				widthLeft -= page.skyline[j].width;
+			}
+
+			int bottom = y + size.y;
+
+			if (bottom > bounds.y)
+				continue;
+
+			if (bottom < bestBottom || (bottom == bestBottom && page.skyline[i].width < bestWidth))
+			{
+				bestBottom = bottom;
+				bestWidth = page.skyline[i].width;
+
+				pos = { x, y };
+				index = i;
+			}
+		}
+
+		return bestBottom <= bounds.y;
+	}
+
+	void TextureAtlas::Insert(Page& page, const vi2d& pos, const vi2d& size, size_t index)
+	{
+		auto& skyline = page.skyline;
+		skyline.insert(skyline.begin() + index, { pos.x, size.x, pos.y + size.y });
+
+		int right = pos.x + size.x;
+
+		// Cut the segments that are now under the new one
+		for (size_t i = index + 1; i < skyline.size();)
+		{
+			if (skyline[i].x >= right)
+				break;
+
+			int shrink = right - skyline[i].x;
+
+			if (shrink < skyline[i].width)
+			{
+				skyline[i].x += shrink;
+				skyline[i].width -= shrink;
+				break;
+			}
+
+			skyline.erase(skyline.begin() + i);
+		}
+
+		for (size_t i = 0; i + 1 < skyline.size();)
+		{
+			if (skyline[i].y == skyline[i + 1].y)
+			{
+				skyline[i].width += skyline[i + 1].width;
+				skyline.erase(skyline.begin() + i + 1);
+			}
+			else
+				i++;
+		}
+	}
+
+	TextureAtlas::Page& TextureAtlas::CreatePage()
+	{
+		Page page;
+
+		page.graphic = new Graphic(m_PageSize);
+		page.graphic->sprite->SetPixelData(NONE);
+		page.skyline.push_back({ 0, m_PageSize.x + m_Padding, 0 });
+
+		m_Pages.push_back(page);
+		return m_Pages.back();
+	}
+
+#endif
+}
+
+#endif
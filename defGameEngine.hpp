@@ -56,8 +56,18 @@
 #include <algorithm>
 #include <functional>
 #include <list>
-
-#ifdef __EMSCRIPTEN__
+#include <deque>
+#include <fstream>
+#include <cstring>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <type_traits>
+
+#if defined(DGE_HEADLESS)
+#define PLATFORM_HEADLESS
+#elif defined(__EMSCRIPTEN__)
 #define PLATFORM_EMSCRIPTEN
 #else
 #define PLATFORM_GL
@@ -70,7 +80,9 @@
 
 #ifdef PLATFORM_EMSCRIPTEN
 #include <EGL/egl.h>
-#include <GLES2/gl2.h>
+
+// WebGL 2 has GL_UNPACK_ROW_LENGTH so only the changed rectangles of the textures are uploaded
+#include <GLES3/gl3.h>
 
 #define GL_GLEXT_PROTOTYPES
 #include <GLES2/gl2ext.h>
@@ -91,6 +103,25 @@
 // Oh, dear stb_image...
 #define SAFE_STBI_FAILURE_REASON() (stbi_failure_reason() ? stbi_failure_reason() : "")
 
+// Define DGE_NO_SIMD to use only the scalar pixel routines
+#ifndef DGE_NO_SIMD
+
+#if defined(__AVX2__)
+#define DGE_SIMD_AVX2
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DGE_SIMD_SSE2
+#endif
+
+#if defined(DGE_SIMD_AVX2)
+#include <immintrin.h>
+#elif defined(DGE_SIMD_SSE2)
+#include <emmintrin.h>
+#endif
+
+#endif
+
 #ifdef _WIN32
 
 #define _CRT_SECURE_NO_WARNINGS
@@ -376,6 +407,24 @@ namespace def
 		constexpr bool operator<=(const float rhs) const;
 
 		constexpr static Pixel Float(float r, float g, float b, float a = 1.0f);
+
+		// Blends src over dest by the alpha of src, the result is opaque
+		constexpr static Pixel Blend(const Pixel& dest, const Pixel& src);
+
+		static void BlendSpan(Pixel* dest, const Pixel& col, size_t count);
+		static void BlendSpan(Pixel* dest, const Pixel* src, size_t count);
+
+		// Copies only the opaque pixels of src
+		static void MaskSpan(Pixel* dest, const Pixel* src, size_t count);
+
+		// Interpolates the four corners by the offsets in 1/256 of a pixel
+		static Pixel Bilinear(const Pixel& tl, const Pixel& tr, const Pixel& bl, const Pixel& br, int offsetX, int offsetY);
+
+		// Interpolates a 4x4 block stored row by row with the weights of its columns and rows
+		static Pixel Bicubic(const Pixel* taps, const float* weightsX, const float* weightsY);
+
+		// Averages the 2x2 blocks of two rows of count * 2 pixels into count pixels
+		static void Downsample(const Pixel* top, const Pixel* bottom, Pixel* dest, size_t count);
 	};
 
 	static const Pixel
@@ -387,12 +436,58 @@ namespace def
 		PINK(255, 109, 194), MAROON(190, 33, 55), LIME(0, 158, 47), BROWN(127, 106, 79),
 		BEIGE(211, 176, 131), VIOLET(135, 60, 190), PURPLE(200, 122, 255), NONE(0, 0, 0, 0);
 
+	// The pixel modes as types for the templated drawing functions of GameEngine,
+	// a function is compiled for every mode so the mode isn't checked for every pixel.
+	// Any functor with the signature of a shader can be used as a mode too.
+	// The modes are defined here so they are inlined into the drawing functions of every file
+	namespace PixelMode
+	{
+		struct Default
+		{
+			Pixel operator()(const vi2d& pos, const Pixel& dest, const Pixel& src) const
+			{
+				return src;
+			}
+		};
+
+		// Writes only the opaque pixels
+		struct Mask
+		{
+			Pixel operator()(const vi2d& pos, const Pixel& dest, const Pixel& src) const
+			{
+				return src.a == 255 ? src : dest;
+			}
+		};
+
+		struct Alpha
+		{
+			Pixel operator()(const vi2d& pos, const Pixel& dest, const Pixel& src) const
+			{
+				return Pixel::Blend(dest, src);
+			}
+		};
+
+		// Calls a shader set with SetShader
+		struct Shader
+		{
+			Pixel(*func)(const vi2d&, const Pixel&, const Pixel&) = nullptr;
+
+			Pixel operator()(const vi2d& pos, const Pixel& dest, const Pixel& src) const
+			{
+				return func(pos, dest, src);
+			}
+		};
+	}
+
 	class Sprite
 	{
 	public:
-		enum class FileType { BMP, PNG, JPG, TGA, TGA_RLE };
+		friend class GameEngine;
+
+		// RAW stores the pixels as they are in memory after a small header, RAW_LZ compresses them
+		enum class FileType { BMP, PNG, JPG, TGA, TGA_RLE, RAW, RAW_LZ };
 
-		enum class SampleMethod { LINEAR, BILINEAR, TRILINEAR };
+		enum class SampleMethod { LINEAR, BILINEAR, BICUBIC, TRILINEAR };
 		enum class WrapMethod { NONE, REPEAT, MIRROR, CLAMP };
 
 		Sprite() = default;
@@ -410,6 +505,10 @@ namespace def
 		void Load(std::string_view fileName);
 		void Save(std::string_view fileName, const FileType type) const;
 
+		// Returns false instead of stopping the application if the file is missing, corrupted or unsupported,
+		// the sprite is left as it was then
+		bool TryLoad(std::string_view fileName);
+
 		bool SetPixel(int x, int y, const Pixel& col);
 		bool SetPixel(const vi2d& pos, const Pixel& col);
 
@@ -418,8 +517,90 @@ namespace def
 
 		void SetPixelData(const Pixel& col);
 
-		Pixel Sample(float x, float y, const SampleMethod sampleMethod, const WrapMethod wrapMethod) const;
-		Pixel Sample(const vf2d& pos, const SampleMethod sampleMethod, const WrapMethod wrapMethod) const;
+		// The level of detail is used only by TRILINEAR, see GetMipLod
+		Pixel Sample(float x, float y, const SampleMethod sampleMethod, const WrapMethod wrapMethod, float lod = 0.0f) const;
+		Pixel Sample(const vf2d& pos, const SampleMethod sampleMethod, const WrapMethod wrapMethod, float lod = 0.0f) const;
+
+		// Samples all of the positions at once, the wrap method is resolved once for the whole batch
+		void SampleBatch(const vf2d* uvs, Pixel* out, size_t count, const SampleMethod sampleMethod, const WrapMethod wrapMethod, float lod = 0.0f) const;
+
+		// Returns the sprite itself for the level 0 and the sprite halved level times for the others,
+		// the levels are built on the first call after the pixels were changed and only where they were changed,
+		// it can be called from a few threads at once
+		const Sprite* GetMipLevel(int level) const;
+		int GetMipLevelsCount() const;
+
+		// Picks the level of detail from the change of uv between neighbouring pixels on the screen
+		float GetMipLod(const vf2d& uvDeltaX, const vf2d& uvDeltaY) const;
+
+		// Marks the region that is uploaded on the next Texture::Update,
+		// call it after writing to the pixels directly
+		void MarkDirty(int x, int y, int width, int height);
+		void MarkDirty();
+
+		bool IsDirty() const;
+		void ClearDirty();
+
+		const vi2d& GetDirtyStart() const;
+		const vi2d& GetDirtyEnd() const;
+
+		// What is known about the alpha of all pixels, the layers use it to skip drawing
+		enum class Content { UNKNOWN, TRANSPARENT, OPAQUE };
+
+		Content GetContent() const;
+		static Content GetContent(const Pixel& col);
+
+	private:
+		void ExpandDirty(int startX, int startY, int endX, int endY);
+
+		template <WrapMethod wrap>
+		const Pixel& GetTap(int x, int y) const;
+
+		template <WrapMethod wrap>
+		void SampleBatch(const vf2d* uvs, Pixel* out, size_t count, const SampleMethod sampleMethod) const;
+
+		// Catmull-Rom weights of the four taps for the offset in 1/256 of a pixel
+		static const float* GetCubicWeights(int offset);
+
+		void BuildMipLevels() const;
+
+		struct RawHeader
+		{
+			char magic[4];
+			uint16_t version;
+			uint16_t flags;
+			int32_t width;
+			int32_t height;
+			uint32_t payloadSize;
+		};
+
+		// Reads the pixels after the header of a RAW or RAW_LZ file, returns false if they are corrupted or unsupported
+		bool LoadRaw(std::ifstream& file, const RawHeader& header);
+		void SaveRaw(std::string_view fileName, bool compress) const;
+
+		// LZ4-like block of sequences of literals and back references
+		static std::vector<uint8_t> CompressLZ(const uint8_t* src, size_t size);
+		static bool DecompressLZ(const uint8_t* src, size_t srcSize, uint8_t* dest, size_t destSize);
+
+		// Replays the recorded drawing before the pixels are changed or freed if it reads or writes them
+		void FlushRecorded() const;
+
+	private:
+		vi2d m_DirtyStart;
+		vi2d m_DirtyEnd;
+
+		Content m_Content = Content::UNKNOWN;
+
+		// The levels from 1, they keep their memory when the pixels are changed
+		mutable std::vector<Sprite> m_MipLevels;
+		mutable bool m_MipLevelsValid = false;
+
+		// The region of the level 0 that was changed since the levels were built
+		vi2d m_MipDirtyStart;
+		vi2d m_MipDirtyEnd;
+
+		// A command recorded by the parallel drawing reads or writes the pixels
+		mutable bool m_IsRecorded = false;
 	};
 
 	struct Texture
@@ -432,35 +613,43 @@ namespace def
 			WIREFRAME
 		};
 
-		Texture(Sprite* sprite);
-		Texture(std::string_view fileName);
+		Texture(Sprite* sprite, bool mipmaps = false);
+		Texture(std::string_view fileName, bool mipmaps = false);
 
 		uint32_t id;
 
 		vf2d uvScale;
 		vi2d size;
 
+		// Uploads the mip levels of the sprite too so the texture is filtered trilinearly when it's minified
+		bool mipmaps;
+
 		void Load(Sprite* sprite);
 		void Update(Sprite* sprite);
 
 	private:
 		void Construct(Sprite* sprite, bool deleteSprite);
 
+		bool CanMipmap(const Sprite* sprite) const;
+
+		void UploadMipLevels(const Sprite* sprite);
+		void UpdateMipLevels(const Sprite* sprite, vi2d start, vi2d end);
+
 	};
 
 	struct Graphic
 	{
 		Graphic() = default;
-		Graphic(std::string_view fileName);
-		Graphic(const vi2d& size);
+		Graphic(std::string_view fileName, bool mipmaps = false);
+		Graphic(const vi2d& size, bool mipmaps = false);
 
 		~Graphic();
 
 		Texture* texture = nullptr;
 		Sprite* sprite = nullptr;
 
-		void Load(std::string_view fileName);
-		void Load(const vi2d& size);
+		void Load(std::string_view fileName, bool mipmaps = false);
+		void Load(const vi2d& size, bool mipmaps = false);
 		void Save(std::string_view fileName, const Sprite::FileType type) const;
 
 		void UpdateTexture();
@@ -473,6 +662,20 @@ namespace def
 		FOCUSED
 	};
 
+	// Decides which parts of a self-intersecting polygon are inside
+	enum class FillRule
+	{
+		NON_ZERO,
+		EVEN_ODD
+	};
+
+	struct TextureVertex
+	{
+		vf2d pos;
+		vf2d uv;
+		Pixel tint;
+	};
+
 	struct TextureInstance
 	{
 		TextureInstance();
@@ -482,13 +685,33 @@ namespace def
 		Texture::Structure structure;
 		uint32_t points;
 
-		std::vector<Pixel> tint;
-		std::vector<vf2d> vertices;
-		std::vector<vf2d> uv;
+		// Index of the first vertex in the vertex arena of the layer
+		uint32_t offset;
 	};
 
 	class GameEngine;
 
+	// Keeps the vertices of a string drawn with DrawTextureString,
+	// they are reused while the string and its position don't change
+	class TextCache
+	{
+	public:
+		friend class GameEngine;
+
+		void Clear();
+
+	private:
+		std::string m_Text;
+
+		vi2d m_Pos;
+		vi2d m_WindowSize;
+		vf2d m_Scale;
+		Pixel m_Col;
+		int m_TabSize = 0;
+
+		std::vector<TextureVertex> m_Vertices;
+	};
+
 	class Platform
 	{
 	public:
@@ -507,7 +730,8 @@ namespace def
 		virtual void PollEvents() const = 0;
 
 		virtual void DrawQuad(const Pixel& tint) const = 0;
-		virtual void DrawTexture(const TextureInstance& texInst) const = 0;
+		virtual void DrawTexture(const TextureInstance& texInst, const TextureVertex* vertices) const = 0;
+		virtual void DrawTextures(const std::vector<TextureInstance>& textures, const std::vector<TextureVertex>& vertices) const;
 
 		virtual void BindTexture(int id) const = 0;
 
@@ -527,7 +751,8 @@ namespace def
 		void OnAfterDraw() override;
 
 		void DrawQuad(const Pixel& tint) const override;
-		void DrawTexture(const TextureInstance& texInst) const override;
+		void DrawTexture(const TextureInstance& texInst, const TextureVertex* vertices) const override;
+		void DrawTextures(const std::vector<TextureInstance>& textures, const std::vector<TextureVertex>& vertices) const override;
 
 		void BindTexture(int id) const override;
 
@@ -543,6 +768,20 @@ namespace def
 		bool ConstructWindow(vi2d& screenSize, const vi2d pixelSize, vi2d& windowSize, bool vsync, bool fullscreen, bool dirtypixel) override;
 
 		void SetIcon(Sprite& icon) const override;
+
+	private:
+		struct Batch
+		{
+			int texture;
+			GLenum mode;
+			GLint first;
+			GLsizei count;
+		};
+
+		// Rebuilt for every layer, the memory is reused between frames
+		mutable std::vector<TextureVertex> m_BatchVertices;
+		mutable std::vector<Batch> m_Batches;
+
 	};
 
 #endif
@@ -606,7 +845,8 @@ namespace def
 		virtual void PollEvents() const override;
 
 		virtual void DrawQuad(const Pixel& tint) const override;
-		virtual void DrawTexture(const TextureInstance& texInst) const override;
+		virtual void DrawTexture(const TextureInstance& texInst, const TextureVertex* vertices) const override;
+		virtual void DrawTextures(const std::vector<TextureInstance>& textures, const std::vector<TextureVertex>& vertices) const override;
 
 		virtual void BindTexture(int id) const override;
 
@@ -617,6 +857,16 @@ namespace def
 		static void MainLoop();
 
 	private:
+		// Specifies the vertex attributes for the bound array buffer
+		void SetVertexLayout() const;
+
+		// Uploads the vertices once and draws the instances as indexed triangle
+		// and line lists with one call per run of instances with the same texture
+		void StreamTextures(const TextureInstance* textures, size_t count, const TextureVertex* vertices, size_t verticesCount) const;
+
+		// Orphans the storage of the bound buffer and fills it, the storage only grows
+		static void UploadStream(GLenum target, size_t& capacity, const void* data, size_t size);
+
 		static EM_BOOL FocusCallback(int eventType, const EmscriptenFocusEvent* event, void* userData);
 		static EM_BOOL KeyboardCallback(int eventType, const EmscriptenKeyboardEvent* event, void* userData);
 		static EM_BOOL WheelCallback(int eventType, const EmscriptenWheelEvent* event, void* userData);
@@ -638,6 +888,12 @@ namespace def
 		uint32_t m_VbQuad = 0;
 		uint32_t m_VaQuad = 0;
 
+		uint32_t m_VbStream = 0;
+		uint32_t m_IbStream = 0;
+
+		mutable size_t m_VbStreamCapacity = 0;
+		mutable size_t m_IbStreamCapacity = 0;
+
 		struct Vertex
 		{
 			float pos[3];
@@ -645,18 +901,93 @@ namespace def
 			Pixel col;
 		};
 
-		mutable Vertex m_VertexMemory[128];
+		struct Batch
+		{
+			int texture;
+			GLenum mode;
+			uint32_t first;
+			uint32_t count;
+		};
+
+		mutable std::vector<Vertex> m_StreamVertices;
+		mutable std::vector<uint32_t> m_StreamIndices;
+		mutable std::vector<Batch> m_Batches;
 
 		Graphic m_BlankQuad;
 	};
 
 	bool Platform_Emscripten::s_IsWindowFocused = false;
 
+#endif
+
+#ifdef PLATFORM_HEADLESS
+
+	/*
+	* Renders everything into an in-memory framebuffer of the screen size,
+	* so the engine can run without a display or a GPU (CI, benchmarks, tests)
+	*/
+	class Platform_Headless : public Platform
+	{
+	public:
+		friend class GameEngine;
+
+		void Destroy() const override;
+		void SetTitle(const std::string& text) const override;
+
+		bool IsWindowClose() const override;
+		bool IsWindowFocused() const override;
+
+		void ClearBuffer(const Pixel& col) const override;
+
+		void OnBeforeDraw() override;
+		void OnAfterDraw() override;
+
+		void FlushScreen(bool vsync) const override;
+		void PollEvents() const override;
+
+		void DrawQuad(const Pixel& tint) const override;
+		void DrawTexture(const TextureInstance& texInst, const TextureVertex* vertices) const override;
+
+		void BindTexture(int id) const override;
+
+		bool ConstructWindow(vi2d& screenSize, const vi2d pixelSize, vi2d& windowSize, bool vsync, bool fullscreen, bool dirtypixel) override;
+
+		void SetIcon(Sprite& icon) const override;
+
+		const Sprite& GetFramebuffer() const;
+
+		static uint32_t CreateTexture(const Sprite* sprite);
+		static void UpdateTexture(uint32_t id, const Sprite* sprite);
+
+	private:
+		const Sprite* GetTexture(int id) const;
+		vf2d ToScreen(const vf2d& ndc) const;
+
+		void Blend(int x, int y, const Pixel& col) const;
+		void RasterTriangle(const TextureVertex& v0, const TextureVertex& v1, const TextureVertex& v2) const;
+		void RasterLine(const TextureVertex& v0, const TextureVertex& v1) const;
+
+		static Pixel Fetch(const Sprite* tex, const vf2d& uv);
+		static Pixel Modulate(const Pixel& texel, const Pixel& tint);
+
+	private:
+		// CPU copies of every texture, indexed by Texture::id - 1
+		inline static std::deque<Sprite> s_Textures;
+
+		mutable Sprite m_Framebuffer;
+		mutable int m_BoundTexture = 0;
+
+	};
+
 #endif
 
 	struct Layer
 	{
 		std::vector<TextureInstance> textures;
+
+		// Frame-lifetime arena for the vertices of the textures,
+		// cleared every frame without releasing its memory
+		std::vector<TextureVertex> vertices;
 		Graphic* pixels = nullptr;
 		Graphic* target = pixels;
 
@@ -672,6 +1003,12 @@ namespace def
 		Pixel tint = WHITE;
 
 		Pixel(*shader)(const vi2d&, const Pixel&, const Pixel&) = nullptr;
+
+		// The pixels won't show up, only known for the layers that are uploaded every frame
+		bool IsEmpty() const;
+
+		// The pixels cover the whole screen
+		bool IsOpaque() const;
 	};
 
 	class GameEngine
@@ -688,6 +1025,10 @@ namespace def
 		friend class Platform_Emscripten;
 #endif
 
+#ifdef PLATFORM_HEADLESS
+		friend class Platform_Headless;
+#endif
+
 	private:
 		std::string m_AppName;
 
@@ -716,6 +1057,12 @@ namespace def
 		Graphic m_Font;
 		int m_TabSize;
 
+		// Texture coordinates of the top left and the bottom right corners of the glyphs
+		vf2d m_GlyphUVs[96][2];
+
+		// A byte for every row of the glyphs, the lowest bit is the leftmost pixel
+		uint8_t m_GlyphBits[96][8];
+
 		std::vector<Layer> m_Layers;
 		size_t m_PickedLayer;
 		size_t m_ConsoleLayer;
@@ -741,11 +1088,73 @@ namespace def
 		};
 
 		std::vector<ConsoleEntry> m_ConsoleHistory;
+
+		// One for every line of the console
+		std::vector<TextCache> m_ConsoleCaches;
 		size_t m_PickedConsoleHistoryCommand;
 
 		float m_DeltaTime;
 		float m_TickTimer;
 
+		float m_FixedDeltaTime;
+		uint32_t m_FramesToRun;
+		uint32_t m_FrameIndex;
+
+		std::ofstream m_InputRecord;
+		std::ifstream m_InputReplay;
+		std::ofstream m_FrameTimings;
+
+		// Pixel work of the software renderer with the layer state it was issued with,
+		// kept per band of rows while drawing in parallel
+		struct DrawCommand
+		{
+			enum class Type : uint8_t
+			{
+				PIXEL,
+				SPAN,
+				SPRITE,
+				CLEAR
+			};
+
+			Type type;
+			Pixel::Mode pixelMode;
+
+			Sprite* target;
+			const Sprite* sprite;
+
+			Pixel(*shader)(const vi2d&, const Pixel&, const Pixel&);
+
+			// PIXEL and SPAN use x, y and endX, SPRITE uses the destination and the source rectangle
+			int x, y, endX;
+			int fileX, fileY, fileSizeX, fileSizeY;
+
+			Pixel col;
+		};
+
+		inline static const int s_DrawBandHeight = 16;
+
+		std::vector<std::vector<DrawCommand>> m_DrawBands;
+		std::vector<const Sprite*> m_DrawTargets;
+
+		// The sprites that the recorded commands read, they are replayed before one of them is drawn onto
+		std::vector<const Sprite*> m_DrawSources;
+
+		std::atomic<size_t> m_NextDrawBand;
+
+		bool m_ParallelDrawing;
+
+#ifndef PLATFORM_EMSCRIPTEN
+		std::vector<std::thread> m_DrawWorkers;
+
+		std::mutex m_DrawMutex;
+		std::condition_variable m_DrawStart;
+		std::condition_variable m_DrawDone;
+
+		uint32_t m_DrawGeneration;
+		size_t m_DrawWorkersDone;
+		bool m_StopDrawWorkers;
+#endif
+
 		Platform* m_Platform;
 
 		std::chrono::system_clock::time_point m_TimeStart;
@@ -776,8 +1185,115 @@ namespace def
 		void ScanHardware(KeyState* data, bool* newState, bool* oldState, size_t count);
 		void MainLoop();
 
+		void RecordInputFrame();
+		void ReplayInputFrame();
+
 		static void MakeUnitCircle(std::vector<vf2d>& circle, const size_t verts);
 
+		TextureVertex* PushTextureInstance(const Texture* tex, Texture::Structure structure, uint32_t points);
+
+		// Writes two triangles for every glyph of the text
+		static uint32_t GetTextureStringPoints(std::string_view text);
+		void BuildTextureString(TextureVertex* dest, const vi2d& pos, std::string_view text, const Pixel& col, const vf2d& scale);
+		void DrawTexturePolygon(const vf2d* verts, const Pixel* cols, uint32_t count, bool gradient, Texture::Structure structure);
+
+		// Writes pixels from startX to endX (both inclusive) straight into the draw target
+		// using the pixel mode of the picked layer, the span is clipped to the target
+		void DrawSpan(int startX, int endX, int y, const Pixel& col);
+
+		template <class Mode>
+		void DrawSpan(int startX, int endX, int y, const Pixel& col, const Mode& mode);
+
+		// Copies the clipped part of the sprite into the draw target row by row
+		template <class Mode>
+		void BlitSprite(int x, int y, int fileX, int fileY, int fileSizeX, int fileSizeY, const Sprite* sprite, const Mode& mode);
+
+		// Calls func with the PixelMode of the picked layer
+		template <class Func>
+		void DispatchPixelMode(Func func);
+
+		// Calls func with the PixelMode that the command was recorded with
+		template <class Func>
+		static void DispatchCommandMode(const DrawCommand& command, Func func);
+
+		// Write the pixels without clipping or marking the target, both the drawing functions
+		// and the recorded commands go through them so the results are the same
+		template <class Mode>
+		static void WritePixel(Sprite* target, int x, int y, const Pixel& col, const Mode& mode);
+
+		template <class Mode>
+		static void WriteSpan(Sprite* target, int startX, int endX, int y, const Pixel& col, const Mode& mode);
+
+		// Writes the rows of the rectangle from startRow to endRow (exclusive)
+		template <class Mode>
+		static void WriteSprite(Sprite* target, int x, int y, int fileX, int fileY, int fileSizeX, int startRow, int endRow, const Sprite* sprite, const Mode& mode);
+
+		// The rasterizers call plot(x, y) for every pixel or span(startX, endX, y) for every row
+		template <class Plot>
+		static void RasterLine(int x1, int y1, int x2, int y2, Plot plot);
+
+		template <class Plot>
+		static void RasterCircle(int x, int y, int radius, Plot plot);
+
+		template <class Plot>
+		static void RasterEllipse(int x, int y, int sizeX, int sizeY, Plot plot);
+
+		template <class Span>
+		static void RasterFillTriangle(int x1, int y1, int x2, int y2, int x3, int y3, Span span);
+
+		template <class Span>
+		static void RasterFillCircle(int x, int y, int radius, Span span);
+
+		template <class Span>
+		static void RasterFillEllipse(int x, int y, int sizeX, int sizeY, Span span);
+
+		// Only the rows from 0 to height (exclusive) are filled
+		template <class Span>
+		static void RasterFillPolygon(const std::vector<vf2d>& points, FillRule rule, int height, Span span);
+
+		// Sets the mode of the command, returns false for the functors that can't be recorded
+		static bool SetCommandMode(const PixelMode::Default& mode, DrawCommand& command);
+		static bool SetCommandMode(const PixelMode::Mask& mode, DrawCommand& command);
+		static bool SetCommandMode(const PixelMode::Alpha& mode, DrawCommand& command);
+		static bool SetCommandMode(const PixelMode::Shader& mode, DrawCommand& command);
+
+		template <class Mode>
+		static bool SetCommandMode(const Mode& mode, DrawCommand& command);
+
+		// What the mode leaves in the pixels it writes col to
+		static Sprite::Content GetWrittenContent(const PixelMode::Default& mode, const Pixel& col);
+		static Sprite::Content GetWrittenContent(const PixelMode::Mask& mode, const Pixel& col);
+		static Sprite::Content GetWrittenContent(const PixelMode::Alpha& mode, const Pixel& col);
+
+		template <class Mode>
+		static Sprite::Content GetWrittenContent(const Mode& mode, const Pixel& col);
+
+		// What the mode leaves in the pixels it copies the sprite to
+		template <class Mode>
+		static Sprite::Content GetWrittenContent(const Mode& mode, const Sprite* sprite);
+
+		// The content of a sprite after a part of it was written
+		static Sprite::Content MergeContent(Sprite::Content content, Sprite::Content written);
+
+		// Marks the rectangle that was written without a command
+		static void MarkWritten(Sprite* target, int x, int y, int sizeX, int sizeY, Sprite::Content written);
+
+		DrawCommand MakeDrawCommand(DrawCommand::Type type) const;
+
+		// Executes the command now or records it while drawing in parallel
+		void SubmitDrawCommand(const DrawCommand& command);
+		static Sprite::Content GetContentAfter(const DrawCommand& command, Sprite::Content content);
+
+		// Writes the pixels of the command that are in the rows from startY to endY (exclusive)
+		static void ExecuteDrawCommand(const DrawCommand& command, int startY, int endY);
+
+		void ReplayDrawBands();
+		void StopDrawWorkers();
+
+#ifndef PLATFORM_EMSCRIPTEN
+		void DrawWorker(uint32_t generation);
+#endif
+
 	public:
 		bool Draw(const vi2d& pos, const Pixel& col = WHITE);
 		virtual bool Draw(int x, int y, const Pixel& col = WHITE);
@@ -821,6 +1337,30 @@ namespace def
 		void FillWireFrameModel(const std::vector<vf2d>& modelCoordinates, const vf2d& pos, float rotation = 0.0f, float scale = 1.0f, const Pixel& col = WHITE);
 		virtual void FillWireFrameModel(const std::vector<vf2d>& modelCoordinates, float x, float y, float rotation = 0.0f, float scale = 1.0f, const Pixel& col = WHITE);
 
+		virtual void FillPolygon(const std::vector<vf2d>& points, const Pixel& col = WHITE, FillRule rule = FillRule::NON_ZERO);
+
+		// Compiled for the pixel mode instead of using the mode of the picked layer, e.g.
+		// FillRectangle<PixelMode::Alpha>(...) or FillCircle(..., [](const vi2d& pos, const Pixel& dest, const Pixel& src) { ... })
+		template <class Mode> bool Draw(int x, int y, const Pixel& col, const Mode& mode = Mode());
+		template <class Mode> void DrawLine(int x1, int y1, int x2, int y2, const Pixel& col, const Mode& mode = Mode());
+
+		template <class Mode> void DrawTriangle(int x1, int y1, int x2, int y2, int x3, int y3, const Pixel& col, const Mode& mode = Mode());
+		template <class Mode> void FillTriangle(int x1, int y1, int x2, int y2, int x3, int y3, const Pixel& col, const Mode& mode = Mode());
+
+		template <class Mode> void DrawRectangle(int x, int y, int sizeX, int sizeY, const Pixel& col, const Mode& mode = Mode());
+		template <class Mode> void FillRectangle(int x, int y, int sizeX, int sizeY, const Pixel& col, const Mode& mode = Mode());
+
+		template <class Mode> void DrawCircle(int x, int y, int radius, const Pixel& col, const Mode& mode = Mode());
+		template <class Mode> void FillCircle(int x, int y, int radius, const Pixel& col, const Mode& mode = Mode());
+
+		template <class Mode> void DrawEllipse(int x, int y, int sizeX, int sizeY, const Pixel& col, const Mode& mode = Mode());
+		template <class Mode> void FillEllipse(int x, int y, int sizeX, int sizeY, const Pixel& col, const Mode& mode = Mode());
+
+		template <class Mode> void FillPolygon(const std::vector<vf2d>& points, const Pixel& col, FillRule rule = FillRule::NON_ZERO, const Mode& mode = Mode());
+
+		template <class Mode> void DrawSprite(int x, int y, const Sprite* sprite, const Mode& mode = Mode());
+		template <class Mode> void DrawPartialSprite(int x, int y, int fileX, int fileY, int fileSizeX, int fileSizeY, const Sprite* sprite, const Mode& mode = Mode());
+
 		void DrawString(const vi2d& pos, std::string_view text, const Pixel& col = WHITE, const vec2d<uint32_t>& scale = { 1, 1 });
 		virtual void DrawString(int x, int y, std::string_view text, const Pixel& col = WHITE, uint32_t scaleX = 1, uint32_t scaleY = 1);
 
@@ -851,6 +1391,7 @@ namespace def
 		void GradientTextureRectangle(const vi2d& pos, const vi2d& size, const Pixel& colTL = WHITE, const Pixel& colTR = WHITE, const Pixel& colBR = WHITE, const Pixel& colBL = WHITE);
 
 		void DrawTextureString(const vi2d& pos, std::string_view text, const Pixel& col = WHITE, const vf2d& scale = { 1.0f, 1.0f });
+		void DrawTextureString(TextCache& cache, const vi2d& pos, std::string_view text, const Pixel& col = WHITE, const vf2d& scale = { 1.0f, 1.0f });
 
 		KeyState GetKey(Key key) const;
 		KeyState GetMouse(Button button) const;
@@ -904,12 +1445,29 @@ namespace def
 		void UseOnlyTextures(bool enable);
 		float GetDeltaTime() const;
 
+		void SetFixedTimeStep(float deltaTime, uint32_t frames = 0);
+		uint32_t GetFrameIndex() const;
+
+		bool RecordInput(std::string_view fileName);
+		bool ReplayInput(std::string_view fileName);
+		bool WriteFrameTimings(std::string_view fileName);
+
+		// Records the software drawing and replays it in bands of rows on the worker threads
+		// at the end of the frame, 0 threads uses every core
+		void SetParallelDrawing(bool enable, uint32_t threads = 0);
+		bool IsParallelDrawing() const;
+
+		// Finishes the recorded drawing, call it before reading the pixels of a draw target
+		void FlushDrawing();
+
 		auto GetWindow()
 		{
 #if defined(PLATFORM_GLFW3)
 			return ((Platform_GLFW3*)m_Platform)->m_Window;
 #elif defined(PLATFORM_EMSCRIPTEN)
 			return ((Platform_Emscripten*)m_Platform)->m_Display;
+#elif defined(PLATFORM_HEADLESS)
+			return &((Platform_Headless*)m_Platform)->m_Framebuffer;
 #endif
 		}
 
@@ -920,152 +1478,11 @@ namespace def
 
 	};
 
-#ifdef DGE_APPLICATION
-#undef DGE_APPLICATION
+	// The templates and the constexpr functions are outside of DGE_APPLICATION so every file
+	// that includes the engine can instantiate them with its own types and modes
 
-	std::unordered_map<Key, std::pair<char, char>> GameEngine::s_KeyboardUS =
-	{
-		{ Key::SPACE, { ' ', ' ' } }, { Key::APOSTROPHE, { '\'', '"' } },
-		{ Key::COMMA, { ',', '<' } }, { Key::MINUS, { '-', '_' } },
-		{ Key::PERIOD, { '.', '>' } }, { Key::SLASH, { '/', '?' } },
-		{ Key::K0, { '0', ')' } }, { Key::K1, { '1', '!' } },
-		{ Key::K2, { '2', '@' } }, { Key::K3, { '3', '#' } },
-		{ Key::K4, { '4', '$' } }, { Key::K5, { '5', '%' } },
-		{ Key::K6, { '6', '^' } }, { Key::K7, { '7', '&' } },
-		{ Key::K8, { '8', '*' } }, { Key::K9, { '9', '(' } },
-		{ Key::SEMICOLON, { ';', ':' } }, { Key::EQUAL, { '=', '+' } },
-		{ Key::A, { 'a', 'A' } }, { Key::B, { 'b', 'B' } },
-		{ Key::C, { 'c', 'C' } }, { Key::D, { 'd', 'D' } },
-		{ Key::E, { 'e', 'E' } }, { Key::F, { 'f', 'F' } },
-		{ Key::G, { 'g', 'G' } }, { Key::H, { 'h', 'H' } },
-		{ Key::I, { 'i', 'I' } }, { Key::J, { 'j', 'J' } },
-		{ Key::K, { 'k', 'K' } }, { Key::L, { 'l', 'L' } },
-		{ Key::M, { 'm', 'M' } }, { Key::N, { 'n', 'N' } },
-		{ Key::O, { 'o', 'O' } }, { Key::P, { 'p', 'P' } },
-		{ Key::Q, { 'q', 'Q' } }, { Key::R, { 'r', 'R' } },
-		{ Key::S, { 's', 'S' } }, { Key::T, { 't', 'T' } },
-		{ Key::U, { 'u', 'U' } }, { Key::V, { 'v', 'V' } },
-		{ Key::W, { 'w', 'W' } }, { Key::X, { 'x', 'X' } },
-		{ Key::Y, { 'y', 'Y' } }, { Key::Z, { 'z', 'Z' } },
-		{ Key::LEFT_BRACKET, { '[', '{' } }, { Key::BACKSLASH, { '\\', '|' } },
-		{ Key::RIGHT_BRACKET, { ']', '}' } },
-		{ Key::NP_0, { '0', '0' } }, { Key::NP_1, { '1', '1' } },
-		{ Key::NP_2, { '2', '2' } }, { Key::NP_3, { '3', '3' } },
-		{ Key::NP_4, { '4', '4' } }, { Key::NP_5, { '5', '5' } },
-		{ Key::NP_6, { '6', '6' } }, { Key::NP_7, { '7', '7' } },
-		{ Key::NP_8, { '8', '8' } }, { Key::NP_9, { '9', '9' } },
-		{ Key::NP_DIVIDE, { '/', '/' } }, { Key::NP_MULTIPLY, { '*', '*' } },
-		{ Key::NP_SUBTRACT, { '-', '-' } }, { Key::NP_ADD, { '+', '+' } },
-		{ Key::NP_EQUAL, { '=', '+' } }
-	};
-
-#ifdef PLATFORM_GLFW3
-
-	std::unordered_map<int, Key> GameEngine::s_KeysTable =
-	{
-		{ GLFW_KEY_SPACE, Key::SPACE }, { GLFW_KEY_APOSTROPHE, Key::APOSTROPHE }, { GLFW_KEY_COMMA, Key::COMMA },
-		{ GLFW_KEY_MINUS, Key::MINUS }, { GLFW_KEY_PERIOD, Key::PERIOD }, { GLFW_KEY_SLASH, Key::SLASH },
-
-		{ GLFW_KEY_0, Key::K0 }, { GLFW_KEY_1, Key::K1 }, { GLFW_KEY_2, Key::K2 }, { GLFW_KEY_3, Key::K3 }, { GLFW_KEY_4, Key::K4 },
-		{ GLFW_KEY_5, Key::K5 }, { GLFW_KEY_6, Key::K6 }, { GLFW_KEY_7, Key::K7 }, { GLFW_KEY_8, Key::K8 }, { GLFW_KEY_9, Key::K9 },
-
-		{ GLFW_KEY_SEMICOLON, Key::SEMICOLON }, { GLFW_KEY_EQUAL, Key::EQUAL },
-
-		{ GLFW_KEY_A, Key::A }, { GLFW_KEY_B, Key::B }, { GLFW_KEY_C, Key::C }, { GLFW_KEY_D, Key::D },
-		{ GLFW_KEY_E, Key::E }, { GLFW_KEY_F, Key::F }, { GLFW_KEY_G, Key::G }, { GLFW_KEY_H, Key::H },
-		{ GLFW_KEY_I, Key::I }, { GLFW_KEY_J, Key::J }, { GLFW_KEY_K, Key::K }, { GLFW_KEY_L, Key::L },
-		{ GLFW_KEY_M, Key::M }, { GLFW_KEY_N, Key::N }, { GLFW_KEY_O, Key::O }, { GLFW_KEY_P, Key::P },
-		{ GLFW_KEY_Q, Key::Q }, { GLFW_KEY_R, Key::R }, { GLFW_KEY_S, Key::S }, { GLFW_KEY_T, Key::T },
-		{ GLFW_KEY_U, Key::U }, { GLFW_KEY_V, Key::V }, { GLFW_KEY_W, Key::W }, { GLFW_KEY_X, Key::X },
-		{ GLFW_KEY_Y, Key::Y }, { GLFW_KEY_Z, Key::Z },
-		{ GLFW_KEY_LEFT_BRACKET, Key::LEFT_BRACKET }, { GLFW_KEY_BACKSLASH, Key::BACKSLASH }, { GLFW_KEY_RIGHT_BRACKET, Key::RIGHT_BRACKET },
-
-		{ GLFW_KEY_ESCAPE, Key::ESCAPE }, { GLFW_KEY_ENTER, Key::ENTER }, { GLFW_KEY_TAB, Key::TAB }, { GLFW_KEY_BACKSPACE, Key::BACKSPACE },
-		{ GLFW_KEY_INSERT, Key::INSERT }, { GLFW_KEY_DELETE, Key::DEL }, { GLFW_KEY_RIGHT, Key::RIGHT }, { GLFW_KEY_LEFT, Key::LEFT },
-		{ GLFW_KEY_DOWN, Key::DOWN }, { GLFW_KEY_UP, Key::UP }, { GLFW_KEY_PAGE_UP, Key::PAGE_UP }, { GLFW_KEY_PAGE_DOWN, Key::PAGE_DOWN },
-		{ GLFW_KEY_HOME, Key::HOME }, { GLFW_KEY_END, Key::END },
-		{ GLFW_KEY_CAPS_LOCK, Key::CAPS_LOCK }, { GLFW_KEY_SCROLL_LOCK, Key::SCROLL_LOCK }, { GLFW_KEY_NUM_LOCK, Key::NUM_LOCK },
-		{ GLFW_KEY_PRINT_SCREEN, Key::PRINT_SCREEN }, { GLFW_KEY_PAUSE, Key::PAUSE },
-
-		{ GLFW_KEY_F1, Key::F1 }, { GLFW_KEY_F2, Key::F2 }, { GLFW_KEY_F3, Key::F3 }, { GLFW_KEY_F4, Key::F4 }, { GLFW_KEY_F5, Key::F5 }, { GLFW_KEY_F6, Key::F6 },
-		{ GLFW_KEY_F7, Key::F7 }, { GLFW_KEY_F8, Key::F8 }, { GLFW_KEY_F9, Key::F9 }, { GLFW_KEY_F10, Key::F10 }, { GLFW_KEY_F11, Key::F11 }, { GLFW_KEY_F12, Key::F12 },
-		{ GLFW_KEY_F13, Key::F13 }, { GLFW_KEY_F14, Key::F14 }, { GLFW_KEY_F15, Key::F15 }, { GLFW_KEY_F16, Key::F16 }, { GLFW_KEY_F17, Key::F17 }, { GLFW_KEY_F18, Key::F18 },
-		{ GLFW_KEY_F19, Key::F19 }, { GLFW_KEY_F20, Key::F20 }, { GLFW_KEY_F21, Key::F21 }, { GLFW_KEY_F22, Key::F22 }, { GLFW_KEY_F23, Key::F23 }, { GLFW_KEY_F24, Key::F24 },
-
-		{ GLFW_KEY_KP_0, Key::NP_0 }, { GLFW_KEY_KP_1, Key::NP_1 }, { GLFW_KEY_KP_2, Key::NP_2 },
-		{ GLFW_KEY_KP_3, Key::NP_3 }, { GLFW_KEY_KP_4, Key::NP_4 }, { GLFW_KEY_KP_5, Key::NP_5 },
-		{ GLFW_KEY_KP_6, Key::NP_6 }, { GLFW_KEY_KP_7, Key::NP_7 }, { GLFW_KEY_KP_8, Key::NP_8 },
-		{ GLFW_KEY_KP_9, Key::NP_9 }, { GLFW_KEY_KP_DECIMAL, Key::NP_DECIMAL },
-		{ GLFW_KEY_KP_DIVIDE, Key::NP_DIVIDE }, { GLFW_KEY_KP_MULTIPLY, Key::NP_MULTIPLY },
-		{ GLFW_KEY_KP_SUBTRACT, Key::NP_SUBTRACT }, { GLFW_KEY_KP_ADD, Key::NP_ADD },
-		{ GLFW_KEY_KP_ENTER, Key::NP_ENTER }, { GLFW_KEY_KP_EQUAL, Key::NP_EQUAL },
-
-		{ GLFW_KEY_LEFT_SHIFT, Key::LEFT_SHIFT }, { GLFW_KEY_LEFT_CONTROL, Key::LEFT_CONTROL },
-		{ GLFW_KEY_LEFT_ALT, Key::LEFT_ALT }, { GLFW_KEY_LEFT_SUPER, Key::LEFT_SUPER },
-		{ GLFW_KEY_RIGHT_SHIFT, Key::RIGHT_SHIFT }, { GLFW_KEY_RIGHT_CONTROL, Key::RIGHT_CONTROL },
-		{ GLFW_KEY_RIGHT_ALT, Key::RIGHT_ALT }, { GLFW_KEY_RIGHT_SUPER, Key::RIGHT_SUPER }, { GLFW_KEY_MENU, Key::MENU },
-
-		{ GLFW_KEY_UNKNOWN, Key::NONE }
-	};
-
-#endif
-
-#ifdef PLATFORM_EMSCRIPTEN
-
-	std::unordered_map<int, Key> GameEngine::s_KeysTable =
-	{
-		{ DOM_PK_SPACE, Key::SPACE }, { DOM_PK_QUOTE, Key::APOSTROPHE }, { DOM_PK_COMMA, Key::COMMA },
-		{ DOM_PK_MINUS, Key::MINUS }, { DOM_PK_PERIOD, Key::PERIOD }, { DOM_PK_SLASH, Key::SLASH },
-
-		{ DOM_PK_0, Key::K0 }, { DOM_PK_1, Key::K1 }, { DOM_PK_2, Key::K2 }, { DOM_PK_3, Key::K3 }, { DOM_PK_4, Key::K4 },
-		{ DOM_PK_5, Key::K5 }, { DOM_PK_6, Key::K6 }, { DOM_PK_7, Key::K7 }, { DOM_PK_8, Key::K8 }, { DOM_PK_9, Key::K9 },
-
-		{ DOM_PK_SEMICOLON, Key::SEMICOLON }, { DOM_PK_EQUAL, Key::EQUAL },
-
-		{ DOM_PK_A, Key::A }, { DOM_PK_B, Key::B }, { DOM_PK_C, Key::C }, { DOM_PK_D, Key::D },
-		{ DOM_PK_E, Key::E }, { DOM_PK_F, Key::F }, { DOM_PK_G, Key::G }, { DOM_PK_H, Key::H },
-		{ DOM_PK_I, Key::I }, { DOM_PK_J, Key::J }, { DOM_PK_K, Key::K }, { DOM_PK_L, Key::L },
-		{ DOM_PK_M, Key::M }, { DOM_PK_N, Key::N }, { DOM_PK_O, Key::O }, { DOM_PK_P, Key::P },
-		{ DOM_PK_Q, Key::Q }, { DOM_PK_R, Key::R }, { DOM_PK_S, Key::S }, { DOM_PK_T, Key::T },
-		{ DOM_PK_U, Key::U }, { DOM_PK_V, Key::V }, { DOM_PK_W, Key::W }, { DOM_PK_X, Key::X },
-		{ DOM_PK_Y, Key::Y }, { DOM_PK_Z, Key::Z },
-
-		{ DOM_PK_BRACKET_LEFT, Key::LEFT_BRACKET }, { DOM_PK_BACKSLASH, Key::BACKSLASH }, { DOM_PK_BRACKET_RIGHT, Key::RIGHT_BRACKET },
-
-		{ DOM_PK_ESCAPE, Key::ESCAPE }, { DOM_PK_ENTER, Key::ENTER }, { DOM_PK_TAB, Key::TAB }, { DOM_PK_BACKSPACE, Key::BACKSPACE },
-		{ DOM_PK_INSERT, Key::INSERT }, { DOM_PK_DELETE, Key::DEL }, { DOM_PK_ARROW_RIGHT, Key::RIGHT }, { DOM_PK_ARROW_LEFT, Key::LEFT },
-		{ DOM_PK_ARROW_DOWN, Key::DOWN }, { DOM_PK_ARROW_UP, Key::UP }, { DOM_PK_PAGE_UP, Key::PAGE_UP }, { DOM_PK_PAGE_DOWN, Key::PAGE_DOWN },
-		{ DOM_PK_HOME, Key::HOME }, { DOM_PK_END, Key::END },
-		{ DOM_PK_CAPS_LOCK, Key::CAPS_LOCK }, { DOM_PK_SCROLL_LOCK, Key::SCROLL_LOCK }, { DOM_PK_NUM_LOCK, Key::NUM_LOCK },
-		{ DOM_PK_PRINT_SCREEN, Key::PRINT_SCREEN }, { DOM_PK_PAUSE, Key::PAUSE },
-
-		{ DOM_PK_F1, Key::F1 }, { DOM_PK_F2, Key::F2 }, { DOM_PK_F3, Key::F3 }, { DOM_PK_F4, Key::F4 }, { DOM_PK_F5, Key::F5 }, { DOM_PK_F6, Key::F6 },
-		{ DOM_PK_F7, Key::F7 }, { DOM_PK_F8, Key::F8 }, { DOM_PK_F9, Key::F9 }, { DOM_PK_F10, Key::F10 }, { DOM_PK_F11, Key::F11 }, { DOM_PK_F12, Key::F12 },
-		{ DOM_PK_F13, Key::F13 }, { DOM_PK_F14, Key::F14 }, { DOM_PK_F15, Key::F15 }, { DOM_PK_F16, Key::F16 }, { DOM_PK_F17, Key::F17 }, { DOM_PK_F18, Key::F18 },
-		{ DOM_PK_F19, Key::F19 }, { DOM_PK_F20, Key::F20 }, { DOM_PK_F21, Key::F21 }, { DOM_PK_F22, Key::F22 }, { DOM_PK_F23, Key::F23 }, { DOM_PK_F24, Key::F24 },
-
-		{ DOM_PK_NUMPAD_0, Key::NP_0 }, { DOM_PK_NUMPAD_1, Key::NP_1 }, { DOM_PK_NUMPAD_2, Key::NP_2 },
-		{ DOM_PK_NUMPAD_3, Key::NP_3 }, { DOM_PK_NUMPAD_4, Key::NP_4 }, { DOM_PK_NUMPAD_5, Key::NP_5 },
-		{ DOM_PK_NUMPAD_6, Key::NP_6 }, { DOM_PK_NUMPAD_7, Key::NP_7 }, { DOM_PK_NUMPAD_8, Key::NP_8 },
-		{ DOM_PK_NUMPAD_9, Key::NP_9 }, { DOM_PK_NUMPAD_DECIMAL, Key::NP_DECIMAL },
-		{ DOM_PK_NUMPAD_DIVIDE, Key::NP_DIVIDE }, { DOM_PK_NUMPAD_MULTIPLY, Key::NP_MULTIPLY },
-		{ DOM_PK_NUMPAD_SUBTRACT, Key::NP_SUBTRACT }, { DOM_PK_NUMPAD_ADD, Key::NP_ADD },
-		{ DOM_PK_NUMPAD_ENTER, Key::NP_ENTER }, { DOM_PK_NUMPAD_EQUAL, Key::NP_EQUAL },
-
-		{ DOM_PK_SHIFT_LEFT, Key::LEFT_SHIFT }, { DOM_PK_CONTROL_LEFT, Key::LEFT_CONTROL },
-		{ DOM_PK_ALT_LEFT, Key::LEFT_ALT }, { DOM_PK_OS_LEFT, Key::LEFT_SUPER },
-		{ DOM_PK_SHIFT_RIGHT, Key::RIGHT_SHIFT }, { DOM_PK_CONTROL_RIGHT, Key::RIGHT_CONTROL },
-		{ DOM_PK_ALT_RIGHT, Key::RIGHT_ALT }, { DOM_PK_OS_RIGHT, Key::RIGHT_SUPER }, { DOM_PK_CONTEXT_MENU, Key::MENU },
-
-		{ DOM_PK_UNKNOWN, Key::NONE }
-	};
-
-#endif
-
-	GameEngine* GameEngine::s_Engine = nullptr;
-
-	template <class... T>
-	void Assert(bool expr, T&&... args)
+	template <class... T>
+	void Assert(bool expr, T&&... args)
 	{
 		if (!expr)
 		{
@@ -1462,11 +1879,6 @@ namespace def
 		);
 	}
 
-	std::string Pixel::str() const
-	{
-		return "(" + std::to_string(r) + ", " + std::to_string(g) + ", " + std::to_string(b) + ", " + std::to_string(a) + ")";
-	}
-
 	constexpr Pixel& Pixel::operator+=(const float rhs)
 	{
 		r = uint8_t(std::clamp((float)r + rhs, 0.0f, 255.0f));
@@ -1622,247 +2034,2239 @@ namespace def
 		return Pixel(uint8_t(r * 255.0f), uint8_t(g * 255.0f), uint8_t(b * 255.0f), uint8_t(a * 255.0f));
 	}
 
-	Sprite::Sprite(const vi2d& size)
+	constexpr Pixel Pixel::Blend(const Pixel& dest, const Pixel& src)
 	{
-		Create(size);
-	}
+		// (d * (255 - a) + s * a) / 255 rounded, (t + (t >> 8)) >> 8 is exact for t < 65536
+		auto blend = [a = (uint32_t)src.a](uint32_t d, uint32_t s)
+			{
+				uint32_t t = d * (255 - a) + s * a + 128;
+				return uint8_t((t + (t >> 8)) >> 8);
+			};
 
-	Sprite::Sprite(std::string_view fileName)
-	{
-		Load(fileName);
+		return Pixel(blend(dest.r, src.r), blend(dest.g, src.g), blend(dest.b, src.b));
 	}
 
-	Sprite::~Sprite()
+	template <class Mode>
+	bool GameEngine::Draw(int x, int y, const Pixel& col, const Mode& mode)
 	{
-	}
+		Layer& layer = m_Layers[m_PickedLayer];
 
-	void Sprite::Create(const vi2d& size)
-	{
-		Assert(size.x > 0 && size.y > 0, "[Sprite.Create Error] Width and height should be > 0");
+		if (!layer.target)
+			return false;
 
-		pixels.clear();
-		this->size = size;
+		Sprite* target = layer.target->sprite;
 
-		pixels.resize(size.x * size.y);
-		std::fill(pixels.begin(), pixels.end(), BLACK);
-	}
+		if (x < 0 || y < 0 || x >= target->size.x || y >= target->size.y)
+			return false;
 
-	void Sprite::Load(std::string_view fileName)
-	{
-		uint8_t* data;
+		if constexpr (std::is_same_v<Mode, PixelMode::Mask>)
+		{
+			if (col.a != 255)
+				return false;
+		}
 
-		Assert(!stbi_is_hdr(fileName.data()), "[stb_image Error] can't load an HDR file");
+		if (m_ParallelDrawing)
+		{
+			DrawCommand command = MakeDrawCommand(DrawCommand::Type::PIXEL);
 
-		data = stbi_load(fileName.data(), &size.x, &size.y, NULL, 4);
-		Assert(data, "[stb_image Error] ", SAFE_STBI_FAILURE_REASON());
+			if (SetCommandMode(mode, command))
+			{
+				command.x = x;
+				command.y = y;
+				command.col = col;
 
-		pixels.clear();
-		pixels.resize(size.x * size.y);
+				SubmitDrawCommand(command);
+				return true;
+			}
 
-		size_t length = size.x * size.y * 4;
-		for (size_t i = 0; i < length; i += 4)
-		{
-			size_t j = i / 4;
-			pixels[j].r = data[i + 0];
-			pixels[j].g = data[i + 1];
-			pixels[j].b = data[i + 2];
-			pixels[j].a = data[i + 3];
+			// Functors can't be recorded so they draw after everything that was recorded
+			FlushDrawing();
 		}
 
-		stbi_image_free(data);
+		WritePixel(target, x, y, col, mode);
+		MarkWritten(target, x, y, 1, 1, GetWrittenContent(mode, col));
+		return true;
 	}
 
-	void Sprite::Save(std::string_view fileName, const FileType type) const
+	template <class Mode>
+	void GameEngine::DrawSpan(int startX, int endX, int y, const Pixel& col, const Mode& mode)
 	{
-		int err = 0;
+		Layer& layer = m_Layers[m_PickedLayer];
 
-		switch (type)
-		{
-		case FileType::BMP: err = stbi_write_bmp(fileName.data(), size.x, size.y, 4, pixels.data()); break;
-		case FileType::PNG: err = stbi_write_png(fileName.data(), size.x, size.y, 4, pixels.data(), size.x * 4); break;
-		case FileType::JPG: err = stbi_write_jpg(fileName.data(), size.x, size.y, 4, pixels.data(), 100); break;
-		case FileType::TGA: err = stbi_write_tga(fileName.data(), size.x, size.y, 4, pixels.data()); break;
-		case FileType::TGA_RLE:
+		if (!layer.target)
+			return;
+
+		Sprite* target = layer.target->sprite;
+
+		if (y < 0 || y >= target->size.y)
+			return;
+
+		startX = std::max(startX, 0);
+		endX = std::min(endX, target->size.x - 1);
+
+		if (startX > endX)
+			return;
+
+		if constexpr (std::is_same_v<Mode, PixelMode::Mask>)
 		{
-			stbi_write_tga_with_rle = 1;
-			err = stbi_write_tga(fileName.data(), size.x, size.y, 4, pixels.data());
-			stbi_write_tga_with_rle = 0;
+			if (col.a != 255)
+				return;
 		}
-		break;
 
-		}
+		if (m_ParallelDrawing)
+		{
+			DrawCommand command = MakeDrawCommand(DrawCommand::Type::SPAN);
 
-		Assert(err == 1, "[stb_image_write Error] Code: ", std::to_string(err).c_str());
-	}
+			if (SetCommandMode(mode, command))
+			{
+				command.x = startX;
+				command.y = y;
+				command.endX = endX;
+				command.col = col;
 
-	bool Sprite::SetPixel(int x, int y, const Pixel& col)
-	{
-		if (x >= 0 && y >= 0 && x < size.x && y < size.y)
-		{
-			pixels[y * size.x + x] = col;
-			return true;
+				SubmitDrawCommand(command);
+				return;
+			}
+
+			FlushDrawing();
 		}
 
-		return false;
+		WriteSpan(target, startX, endX, y, col, mode);
+		MarkWritten(target, startX, y, endX - startX + 1, 1, GetWrittenContent(mode, col));
 	}
 
-	bool Sprite::SetPixel(const vi2d& pos, const Pixel& col)
+	template <class Mode>
+	void GameEngine::BlitSprite(int x, int y, int fileX, int fileY, int fileSizeX, int fileSizeY, const Sprite* sprite, const Mode& mode)
 	{
-		return SetPixel(pos.x, pos.y, col);
-	}
+		Layer& layer = m_Layers[m_PickedLayer];
 
-	Pixel Sprite::GetPixel(int x, int y, const WrapMethod wrap) const
-	{
-		auto GetPixel = [&pixels = pixels, &size = size](int x, int y)
-			{
-				return pixels[y * size.x + x];
-			};
+		if (!layer.target)
+			return;
 
-		switch (wrap)
-		{
-		case WrapMethod::NONE:
-		{
-			if (x >= 0 && y >= 0 && x < size.x && y < size.y)
-				return GetPixel(x, y);
-		}
-		break;
+		Sprite* target = layer.target->sprite;
 
-		case WrapMethod::REPEAT:
-			return GetPixel(abs(x) % size.x, abs(y) % size.y);
+		// Clip the source rectangle to the sprite first and then to the target
 
-		case WrapMethod::MIRROR:
-		{
-			int mx = (x < 0) ? size.x - 1 - abs(x) % size.x : abs(x) % size.x;
-			int my = (y < 0) ? size.y - 1 - abs(y) % size.y : abs(y) % size.y;
+		if (fileX < 0) { x -= fileX; fileSizeX += fileX; fileX = 0; }
+		if (fileY < 0) { y -= fileY; fileSizeY += fileY; fileY = 0; }
 
-			return GetPixel(mx, my);
-		}
+		if (x < 0) { fileX -= x; fileSizeX += x; x = 0; }
+		if (y < 0) { fileY -= y; fileSizeY += y; y = 0; }
 
-		case WrapMethod::CLAMP:
+		fileSizeX = std::min({ fileSizeX, sprite->size.x - fileX, target->size.x - x });
+		fileSizeY = std::min({ fileSizeY, sprite->size.y - fileY, target->size.y - y });
+
+		if (fileSizeX <= 0 || fileSizeY <= 0)
+			return;
+
+		if (m_ParallelDrawing)
 		{
-			int cx = std::clamp(x, 0, size.x - 1);
-			int cy = std::clamp(y, 0, size.y - 1);
+			DrawCommand command = MakeDrawCommand(DrawCommand::Type::SPRITE);
 
-			return GetPixel(cx, cy);
-		}
+			if (SetCommandMode(mode, command))
+			{
+				command.sprite = sprite;
+				command.x = x;
+				command.y = y;
+				command.fileX = fileX;
+				command.fileY = fileY;
+				command.fileSizeX = fileSizeX;
+				command.fileSizeY = fileSizeY;
+
+				SubmitDrawCommand(command);
+				return;
+			}
 
+			FlushDrawing();
 		}
 
-		return BLACK;
+		WriteSprite(target, x, y, fileX, fileY, fileSizeX, 0, fileSizeY, sprite, mode);
+		MarkWritten(target, x, y, fileSizeX, fileSizeY, GetWrittenContent(mode, sprite));
 	}
 
-	Pixel Sprite::GetPixel(const vi2d& pos, const WrapMethod wrap) const
+	template <class Func>
+	void GameEngine::DispatchPixelMode(Func func)
 	{
-		return GetPixel(pos.x, pos.y, wrap);
+		const Layer& layer = m_Layers[m_PickedLayer];
+
+		switch (layer.pixelMode)
+		{
+		case Pixel::Mode::DEFAULT: func(PixelMode::Default()); break;
+		case Pixel::Mode::MASK: func(PixelMode::Mask()); break;
+		case Pixel::Mode::ALPHA: func(PixelMode::Alpha()); break;
+		case Pixel::Mode::CUSTOM: func(PixelMode::Shader{ layer.shader }); break;
+		}
 	}
 
-	void Sprite::SetPixelData(const Pixel& col)
+	template <class Func>
+	void GameEngine::DispatchCommandMode(const DrawCommand& command, Func func)
 	{
-		std::fill(pixels.begin(), pixels.end(), col);
+		switch (command.pixelMode)
+		{
+		case Pixel::Mode::DEFAULT: func(PixelMode::Default()); break;
+		case Pixel::Mode::MASK: func(PixelMode::Mask()); break;
+		case Pixel::Mode::ALPHA: func(PixelMode::Alpha()); break;
+		case Pixel::Mode::CUSTOM: func(PixelMode::Shader{ command.shader }); break;
+		}
 	}
 
-	Pixel Sprite::Sample(float x, float y, const SampleMethod sample, const WrapMethod wrap) const
+	template <class Mode>
+	void GameEngine::WritePixel(Sprite* target, int x, int y, const Pixel& col, const Mode& mode)
 	{
-		return Sample({ x, y }, sample, wrap);
+		Pixel& dest = target->pixels[y * target->size.x + x];
+		dest = mode({ x, y }, dest, col);
 	}
 
-	Pixel Sprite::Sample(const vf2d& pos, const SampleMethod sample, const WrapMethod wrap) const
+	template <class Mode>
+	void GameEngine::WriteSpan(Sprite* target, int startX, int endX, int y, const Pixel& col, const Mode& mode)
 	{
-		vf2d denorm = pos * vf2d(size);
+		Pixel* row = target->pixels.data() + y * target->size.x;
 
-		switch (sample)
-		{
-		case SampleMethod::LINEAR:
-			return GetPixel(denorm, wrap);
+		if constexpr (std::is_same_v<Mode, PixelMode::Default> || std::is_same_v<Mode, PixelMode::Mask>)
+			std::fill(row + startX, row + endX + 1, col);
 
-		case SampleMethod::BILINEAR:
-		{
-			vf2d cell = denorm.floor();
-			vf2d offset = denorm - cell;
+		else if constexpr (std::is_same_v<Mode, PixelMode::Alpha>)
+			Pixel::BlendSpan(row + startX, col, endX - startX + 1);
 
-			Pixel tl = GetPixel(cell + vf2d(0, 0), wrap);
-			Pixel tr = GetPixel(cell + vf2d(1, 0), wrap);
-			Pixel bl = GetPixel(cell + vf2d(0, 1), wrap);
-			Pixel br = GetPixel(cell + vf2d(1, 1), wrap);
+		else
+		{
+			for (int x = startX; x <= endX; x++)
+				row[x] = mode({ x, y }, row[x], col);
+		}
+	}
 
-			Pixel topCol = tr * offset.x + tl * (1.0f - offset.x);
-			Pixel bottomCol = br * offset.x + bl * (1.0f - offset.x);
+	template <class Mode>
+	void GameEngine::WriteSprite(Sprite* target, int x, int y, int fileX, int fileY, int fileSizeX, int startRow, int endRow, const Sprite* sprite, const Mode& mode)
+	{
+		// A sprite drawn lower onto itself would overwrite its rows before they are read,
+		// so they go from the bottom then
+		bool fromBottom = sprite == target && y > fileY;
 
-			return bottomCol * offset.y + topCol * (1.0f - offset.y);
-		}
+		std::vector<Pixel> rowCopy;
 
-		case SampleMethod::TRILINEAR:
+		for (int n = startRow; n < endRow; n++)
 		{
-			vi2d center = (denorm - vf2d(0.5f, 0.5f)).floor();
-			vf2d offset = (denorm - vf2d(0.5f, 0.5f)) - vf2d(center);
-
-			struct Pixelf
-			{
-				float r = 0.0f;
-				float g = 0.0f;
-				float b = 0.0f;
-				float a = 0.0f;
-			};
+			int i = fromBottom ? startRow + endRow - 1 - n : n;
 
-			Pixelf splineX[4][4];
+			Pixel* dest = target->pixels.data() + (y + i) * target->size.x + x;
+			const Pixel* src = sprite->pixels.data() + (fileY + i) * sprite->size.x + fileX;
 
-			vec2d<size_t> s;
-			for (s.y = 0; s.y < 4; s.y++)
-				for (s.x = 0; s.x < 4; s.x++)
+			// The other modes read the source while writing so a row of the sprite itself is copied first
+			if constexpr (!std::is_same_v<Mode, PixelMode::Default>)
+			{
+				if (sprite == target)
 				{
-					Pixel p = GetPixel(center + s - 1, wrap);
-					splineX[s.y][s.x] = { (float)p.r, (float)p.g, (float)p.b, (float)p.a };
+					rowCopy.assign(src, src + fileSizeX);
+					src = rowCopy.data();
 				}
+			}
 
-			vf2d t = offset;
-			vf2d tt = t * t;
-			vf2d ttt = tt * tt;
-
-			vf2d q[4];
-			q[0] = 0.5f * (-1.0f * ttt + 2.0f * tt - t);
-			q[1] = 0.5f * (3.0f * ttt - 5.0f * tt + 2.0f);
-			q[2] = 0.5f * (-3.0f * ttt + 4.0f * tt + t);
-			q[3] = 0.5f * (ttt - tt);
+			if constexpr (std::is_same_v<Mode, PixelMode::Default>)
+				memmove(dest, src, fileSizeX * sizeof(Pixel));
 
-			Pixelf splineY[4];
+			else if constexpr (std::is_same_v<Mode, PixelMode::Mask>)
+				Pixel::MaskSpan(dest, src, fileSizeX);
 
-			for (size_t s = 0; s < 4; s++)
-				for (size_t i = 0; i < 4; i++)
-				{
-					splineY[s].r += splineX[s][i].r * q[i].x;
-					splineY[s].g += splineX[s][i].g * q[i].x;
-					splineY[s].b += splineX[s][i].b * q[i].x;
-					splineY[s].a += splineX[s][i].a * q[i].x;
-				}
+			else if constexpr (std::is_same_v<Mode, PixelMode::Alpha>)
+				Pixel::BlendSpan(dest, src, fileSizeX);
 
-			Pixelf pix;
-			for (size_t i = 0; i < 4; i++)
+			else
 			{
-				pix.r += splineY[i].r * q[i].y;
-				pix.g += splineY[i].g * q[i].y;
-				pix.b += splineY[i].b * q[i].y;
-				pix.a += splineY[i].a * q[i].y;
+				for (int j = 0; j < fileSizeX; j++)
+					dest[j] = mode({ x + j, y + i }, dest[j], src[j]);
 			}
+		}
+	}
+
+	template <class Mode>
+	bool GameEngine::SetCommandMode(const Mode& mode, DrawCommand& command)
+	{
+		return false;
+	}
+
+	template <class Mode>
+	Sprite::Content GameEngine::GetWrittenContent(const Mode& mode, const Pixel& col)
+	{
+		return Sprite::Content::UNKNOWN;
+	}
+
+	template <class Mode>
+	Sprite::Content GameEngine::GetWrittenContent(const Mode& mode, const Sprite* sprite)
+	{
+		// Apart from copying the pixels of the sprite are unknown so only the mode decides
+		if constexpr (std::is_same_v<Mode, PixelMode::Default>)
+			return sprite->m_Content;
+		else
+			return GetWrittenContent(mode, WHITE);
+	}
+
+	template <class Plot>
+	void GameEngine::RasterLine(int x1, int y1, int x2, int y2, Plot plot)
+	{
+		int dx = x2 - x1;
+		int dy = y2 - y1;
+
+		int dx1 = abs(dx);
+		int dy1 = abs(dy);
+
+		int px = 2 * dy1 - dx1;
+		int py = 2 * dx1 - dy1;
+
+		int x, y, xe, ye;
+
+		if (dy1 <= dx1)
+		{
+			if (dx >= 0)
+			{
+				x = x1;
+				y = y1;
+				xe = x2;
+			}
+			else
+			{
+				x = x2;
+				y = y2;
+				xe = x1;
+			}
+
+			plot(x, y);
+
+			while (x < xe)
+			{
+				x++;
+
+				if (px < 0)
+					px = px + 2 * dy1;
+				else
+				{
+					y += ((dx < 0 && dy < 0) || (dx > 0 && dy > 0)) ? 1 : -1;
+					px = px + 2 * (dy1 - dx1);
+				}
+
+				plot(x, y);
+			}
+		}
+		else
+		{
+			if (dy >= 0)
+			{
+				x = x1;
+				y = y1;
+				ye = y2;
+			}
+			else
+			{
+				x = x2;
+				y = y2;
+				ye = y1;
+			}
+
+			plot(x, y);
+
+			while (y < ye)
+			{
+				y++;
+
+				if (py <= 0)
+					py = py + 2 * dx1;
+				else
+				{
+					x += ((dx < 0 && dy < 0) || (dx > 0 && dy > 0)) ? 1 : -1;
+					py = py + 2 * (dx1 - dy1);
+				}
+
+				plot(x, y);
+			}
+		}
+	}
+
+	template <class Span>
+	void GameEngine::RasterFillTriangle(int x1, int y1, int x2, int y2, int x3, int y3, Span span)
+	{
+		int t1x, t2x, y, minx, maxx, t1xp, t2xp;
+
+		bool changed1 = false;
+		bool changed2 = false;
+
+		int signx1, signx2, dx1, dy1, dx2, dy2;
+		int e1, e2;
+
+		if (y1 > y2)
+		{
+			std::swap(y1, y2);
+			std::swap(x1, x2);
+		}
+
+		if (y1 > y3)
+		{
+			std::swap(y1, y3);
+			std::swap(x1, x3);
+		}
+
+		if (y2 > y3)
+		{
+			std::swap(y2, y3);
+			std::swap(x2, x3);
+		}
+
+		t1x = t2x = x1;
+		y = y1;
+		dx1 = x2 - x1;
+
+		if (dx1 < 0)
+		{
+			dx1 = -dx1;
+			signx1 = -1;
+		}
+		else
+			signx1 = 1;
+
+		dy1 = y2 - y1;
+		dx2 = x3 - x1;
+
+		if (dx2 < 0)
+		{
+			dx2 = -dx2;
+			signx2 = -1;
+		}
+		else
+			signx2 = 1;
+
+		dy2 = y3 - y1;
+
+		if (dy1 > dx1)
+		{
+			std::swap(dx1, dy1);
+			changed1 = true;
+		}
+
+		if (dy2 > dx2)
+		{
+			std::swap(dy2, dx2);
+			changed2 = true;
+		}
+
+		e2 = dx2 >> 1;
+
+		if (y1 == y2)
+			goto next;
+
+		e1 = dx1 >> 1;
+
+		for (int i = 0; i < dx1;)
+		{
+			t1xp = t2xp = 0;
+
+			if (t1x < t2x)
+			{
+				minx = t1x;
+				maxx = t2x;
+			}
+			else
+			{
+				minx = t2x;
+				maxx = t1x;
+			}
+
+			while (i++ < dx1)
+			{
+				e1 += dy1;
+
+				while (e1 >= dx1)
+				{
+					e1 -= dx1;
+
+					if (changed1)
+						t1xp = signx1;
+					else
+						goto next1;
+				}
+
+				if (changed1)
+					break;
+				else
+					t1x += signx1;
+			}
+
+		next1:
+			while (1)
+			{
+				e2 += dy2;
+
+				while (e2 >= dx2)
+				{
+					e2 -= dx2;
+
+					if (changed2)
+						t2xp = signx2;
+					else
+						goto next2;
+				}
+
+				if (changed2)
+					break;
+				else
+					t2x += signx2;
+			}
+
+		next2:
+			if (minx > t1x) minx = t1x;
+			if (minx > t2x) minx = t2x;
+			if (maxx < t1x) maxx = t1x;
+			if (maxx < t2x) maxx = t2x;
+
+			span(minx, maxx, y);
+
+			if (!changed1)
+				t1x += signx1;
+
+			t1x += t1xp;
+
+			if (!changed2)
+				t2x += signx2;
+
+			t2x += t2xp;
+			y++;
+
+			if (y == y2)
+				break;
+		}
+
+	next:
+		dx1 = x3 - x2;
+
+		if (dx1 < 0)
+		{
+			dx1 = -dx1;
+			signx1 = -1;
+		}
+		else
+			signx1 = 1;
+
+		dy1 = y3 - y2;
+		t1x = x2;
+
+		if (dy1 > dx1)
+		{
+			std::swap(dy1, dx1);
+			changed1 = true;
+		}
+		else
+			changed1 = false;
+
+		e1 = dx1 >> 1;
+
+		for (int i = 0; i <= dx1; i++)
+		{
+			t1xp = t2xp = 0;
+
+			if (t1x < t2x)
+			{
+				minx = t1x;
+				maxx = t2x;
+			}
+			else
+			{
+				minx = t2x;
+				maxx = t1x;
+			}
+
+			while (i < dx1)
+			{
+				e1 += dy1;
+
+				while (e1 >= dx1)
+				{
+					e1 -= dx1;
+
+					if (changed1)
+					{
+						t1xp = signx1;
+						break;
+					}
+					else
+						goto next3;
+				}
+
+				if (changed1)
+					break;
+				else
+					t1x += signx1;
+
+				if (i < dx1) i++;
+			}
+
+		next3:
+			while (t2x != x3)
+			{
+				e2 += dy2;
+
+				while (e2 >= dx2)
+				{
+					e2 -= dx2;
+
+					if (changed2)
+						t2xp = signx2;
+					else
+						goto next4;
+				}
+
+				if (changed2)
+					break;
+				else
+					t2x += signx2;
+			}
+
+		next4:
+			if (minx > t1x) minx = t1x;
+			if (minx > t2x) minx = t2x;
+			if (maxx < t1x) maxx = t1x;
+			if (maxx < t2x) maxx = t2x;
+
+			span(minx, maxx, y);
+
+			if (!changed1)
+				t1x += signx1;
+
+			t1x += t1xp;
+
+			if (!changed2)
+				t2x += signx2;
+
+			t2x += t2xp;
+			y++;
+
+			if (y > y3)
+				return;
+		}
+	}
+
+	template <class Plot>
+	void GameEngine::RasterCircle(int x, int y, int radius, Plot plot)
+	{
+		int x1 = 0;
+		int y1 = radius;
+		int p1 = 3 - 2 * radius;
+
+		while (y1 >= x1)
+		{
+			plot(x - x1, y - y1);
+			plot(x - y1, y - x1);
+			plot(x + y1, y - x1);
+			plot(x + x1, y - y1);
+			plot(x - x1, y + y1);
+			plot(x - y1, y + x1);
+			plot(x + y1, y + x1);
+			plot(x + x1, y + y1);
+
+			if (p1 < 0)
+			{
+				p1 += 4 * x1 + 6;
+				x1++;
+			}
+			else
+			{
+				p1 += 4 * (x1 - y1) + 10;
+				x1++;
+				y1--;
+			}
+		}
+	}
+
+	template <class Span>
+	void GameEngine::RasterFillCircle(int x, int y, int radius, Span span)
+	{
+		int x1 = 0;
+		int y1 = radius;
+		int p1 = 3 - 2 * radius;
+
+		while (y1 >= x1)
+		{
+			span(x - x1, x + x1, y - y1);
+			span(x - y1, x + y1, y - x1);
+			span(x - x1, x + x1, y + y1);
+			span(x - y1, x + y1, y + x1);
+
+			if (p1 < 0)
+			{
+				p1 += 4 * x1 + 6;
+				x1++;
+			}
+			else
+			{
+				p1 += 4 * (x1 - y1) + 10;
+				x1++;
+				y1--;
+			}
+		}
+	}
+
+	template <class Plot>
+	void GameEngine::RasterEllipse(int x, int y, int sizeX, int sizeY, Plot plot)
+	{
+		int x1 = x + sizeX;
+		int y1 = y + sizeY;
+
+		int a = abs(x1 - x);
+		int b = abs(y1 - y);
+		int b1 = b & 1;
+
+		int dx = 4 * (1 - a) * b * b;
+		int dy = 4 * (b1 + 1) * a * a;
+
+		int err = dx + dy + b1 * a * a;
+
+		if (x > x1)
+		{
+			x = x1;
+			x1 += a;
+		}
+
+		if (y > y1)
+			y = y1;
+
+		y += (b + 1) / 2;
+		y1 = y - b1;
+
+		a *= 8 * a;
+		b1 = 8 * b * b;
+
+		do
+		{
+			plot(x1, y);
+			plot(x, y);
+			plot(x, y1);
+			plot(x1, y1);
+
+			int e2 = 2 * err;
+
+			if (e2 <= dy)
+			{
+				y++;
+				y1--;
+				err += dy += a;
+			}
+
+			if (e2 >= dx || 2 * err > dy)
+			{
+				x++;
+				x1--;
+				err += dx += b1;
+			}
+		} while (x <= x1);
+
+		while (y - y1 < b)
+		{
+			plot(x - 1, y);
+			plot(x1 + 1, y++);
+			plot(x - 1, y1);
+			plot(x1 + 1, y1--);
+		}
+	}
+
+	template <class Span>
+	void GameEngine::RasterFillEllipse(int x, int y, int sizeX, int sizeY, Span span)
+	{
+		int x1 = x + sizeX;
+		int y1 = y + sizeY;
+
+		int a = abs(x1 - x);
+		int b = abs(y1 - y);
+		int b1 = b & 1;
+
+		int dx = 4 * (1 - a) * b * b;
+		int dy = 4 * (b1 + 1) * a * a;
+
+		int err = dx + dy + b1 * a * a;
+
+		if (x > x1)
+		{
+			x = x1;
+			x1 += a;
+		}
+
+		if (y > y1)
+			y = y1;
+
+		y += (b + 1) / 2;
+		y1 = y - b1;
+
+		a *= 8 * a;
+		b1 = 8 * b * b;
+
+		do
+		{
+			span(x, x1, y);
+			span(x, x1, y1);
+
+			int e2 = 2 * err;
+
+			if (e2 <= dy)
+			{
+				y++;
+				y1--;
+				err += dy += a;
+			}
+
+			if (e2 >= dx || 2 * err > dy)
+			{
+				x++;
+				x1--;
+				err += dx += b1;
+			}
+		} while (x <= x1);
+
+		while (y - y1 < b)
+		{
+			span(x - 1, x1 + 1, y++);
+			span(x - 1, x1 + 1, y1--);
+		}
+	}
+
+	template <class Mode>
+	void GameEngine::DrawLine(int x1, int y1, int x2, int y2, const Pixel& col, const Mode& mode)
+	{
+		RasterLine(x1, y1, x2, y2, [&](int x, int y) { Draw(x, y, col, mode); });
+	}
+
+	template <class Mode>
+	void GameEngine::DrawTriangle(int x1, int y1, int x2, int y2, int x3, int y3, const Pixel& col, const Mode& mode)
+	{
+		DrawLine(x1, y1, x2, y2, col, mode);
+		DrawLine(x2, y2, x3, y3, col, mode);
+		DrawLine(x3, y3, x1, y1, col, mode);
+	}
+
+	template <class Mode>
+	void GameEngine::FillTriangle(int x1, int y1, int x2, int y2, int x3, int y3, const Pixel& col, const Mode& mode)
+	{
+		RasterFillTriangle(x1, y1, x2, y2, x3, y3, [&](int startX, int endX, int y) { DrawSpan(startX, endX, y, col, mode); });
+	}
+
+	template <class Mode>
+	void GameEngine::DrawRectangle(int x, int y, int sizeX, int sizeY, const Pixel& col, const Mode& mode)
+	{
+		// Every pixel is drawn once so the blending modes don't cover the corners twice
+		DrawSpan(x, x + sizeX - 1, y, col, mode);
+
+		if (sizeY != 0)
+			DrawSpan(x, x + sizeX - 1, y + sizeY, col, mode);
+
+		for (int i = 1; i < sizeY; i++)
+		{
+			Draw(x, y + i, col, mode);
+
+			if (sizeX > 1)
+				Draw(x + sizeX - 1, y + i, col, mode);
+		}
+	}
+
+	template <class Mode>
+	void GameEngine::FillRectangle(int x, int y, int sizeX, int sizeY, const Pixel& col, const Mode& mode)
+	{
+		for (int j = 0; j < sizeY; j++)
+			DrawSpan(x, x + sizeX - 1, y + j, col, mode);
+	}
+
+	template <class Mode>
+	void GameEngine::DrawCircle(int x, int y, int radius, const Pixel& col, const Mode& mode)
+	{
+		RasterCircle(x, y, radius, [&](int px, int py) { Draw(px, py, col, mode); });
+	}
+
+	template <class Mode>
+	void GameEngine::FillCircle(int x, int y, int radius, const Pixel& col, const Mode& mode)
+	{
+		RasterFillCircle(x, y, radius, [&](int startX, int endX, int py) { DrawSpan(startX, endX, py, col, mode); });
+	}
+
+	template <class Mode>
+	void GameEngine::DrawEllipse(int x, int y, int sizeX, int sizeY, const Pixel& col, const Mode& mode)
+	{
+		RasterEllipse(x, y, sizeX, sizeY, [&](int px, int py) { Draw(px, py, col, mode); });
+	}
+
+	template <class Mode>
+	void GameEngine::FillEllipse(int x, int y, int sizeX, int sizeY, const Pixel& col, const Mode& mode)
+	{
+		RasterFillEllipse(x, y, sizeX, sizeY, [&](int startX, int endX, int py) { DrawSpan(startX, endX, py, col, mode); });
+	}
+
+	template <class Mode>
+	void GameEngine::FillPolygon(const std::vector<vf2d>& points, const Pixel& col, FillRule rule, const Mode& mode)
+	{
+		Layer& layer = m_Layers[m_PickedLayer];
+
+		if (layer.target)
+			RasterFillPolygon(points, rule, layer.target->sprite->size.y, [&](int startX, int endX, int y) { DrawSpan(startX, endX, y, col, mode); });
+	}
+
+	template <class Mode>
+	void GameEngine::DrawSprite(int x, int y, const Sprite* sprite, const Mode& mode)
+	{
+		BlitSprite(x, y, 0, 0, sprite->size.x, sprite->size.y, sprite, mode);
+	}
+
+	template <class Mode>
+	void GameEngine::DrawPartialSprite(int x, int y, int fileX, int fileY, int fileSizeX, int fileSizeY, const Sprite* sprite, const Mode& mode)
+	{
+		BlitSprite(x, y, fileX, fileY, fileSizeX, fileSizeY, sprite, mode);
+	}
+
+	template <class Span>
+	void GameEngine::RasterFillPolygon(const std::vector<vf2d>& points, FillRule rule, int height, Span span)
+	{
+		if (points.size() < 3)
+			return;
+
+		struct Edge
+		{
+			vf2d start;
+			float slope;
+
+			// Rows whose centres lie between the ends of the edge
+			int startY;
+			int endY;
+
+			int winding;
+		};
+
+		std::vector<Edge> edges;
+		edges.reserve(points.size());
+
+		for (size_t i = 0; i < points.size(); i++)
+		{
+			vf2d p1 = points[i];
+			vf2d p2 = points[(i + 1) % points.size()];
+
+			int winding = 1;
+
+			if (p1.y > p2.y)
+			{
+				std::swap(p1, p2);
+				winding = -1;
+			}
+
+			Edge edge;
+
+			edge.start = p1;
+			edge.startY = std::max((int)ceilf(p1.y - 0.5f), 0);
+			edge.endY = std::min((int)ceilf(p2.y - 0.5f), height);
+			edge.winding = winding;
+
+			// Horizontal edges never cross the centre of a row
+			if (edge.startY >= edge.endY)
+				continue;
+
+			edge.slope = (p2.x - p1.x) / (p2.y - p1.y);
+			edges.push_back(edge);
+		}
+
+		if (edges.empty())
+			return;
+
+		std::sort(edges.begin(), edges.end(), [](const Edge& lhs, const Edge& rhs) { return lhs.startY < rhs.startY; });
+
+		std::vector<const Edge*> active;
+		std::vector<std::pair<float, int>> crossings;
+
+		size_t next = 0;
+
+		for (int y = edges.front().startY; next < edges.size() || !active.empty(); y++)
+		{
+			while (next < edges.size() && edges[next].startY == y)
+				active.push_back(&edges[next++]);
+
+			active.erase(std::remove_if(active.begin(), active.end(), [y](const Edge* edge) { return edge->endY <= y; }), active.end());
+
+			if (active.empty())
+			{
+				// Jump over the gap between two parts of the polygon
+				if (next < edges.size())
+					y = edges[next].startY - 1;
+
+				continue;
+			}
+
+			float centre = (float)y + 0.5f;
+			crossings.clear();
+
+			for (const Edge* edge : active)
+				crossings.push_back({ edge->start.x + (centre - edge->start.y) * edge->slope, edge->winding });
+
+			std::sort(crossings.begin(), crossings.end());
+
+			int winding = 0;
+
+			for (size_t i = 0; i + 1 < crossings.size(); i++)
+			{
+				winding += rule == FillRule::EVEN_ODD ? 1 : crossings[i].second;
+
+				bool inside = rule == FillRule::EVEN_ODD ? (winding & 1) : winding != 0;
+
+				// Fill the pixels whose centres lie between the crossings
+				if (inside)
+					span((int)ceilf(crossings[i].first - 0.5f), (int)ceilf(crossings[i + 1].first - 0.5f) - 1, y);
+			}
+		}
+	}
+
+#ifdef DGE_APPLICATION
+#undef DGE_APPLICATION
+
+	std::unordered_map<Key, std::pair<char, char>> GameEngine::s_KeyboardUS =
+	{
+		{ Key::SPACE, { ' ', ' ' } }, { Key::APOSTROPHE, { '\'', '"' } },
+		{ Key::COMMA, { ',', '<' } }, { Key::MINUS, { '-', '_' } },
+		{ Key::PERIOD, { '.', '>' } }, { Key::SLASH, { '/', '?' } },
+		{ Key::K0, { '0', ')' } }, { Key::K1, { '1', '!' } },
+		{ Key::K2, { '2', '@' } }, { Key::K3, { '3', '#' } },
+		{ Key::K4, { '4', '$' } }, { Key::K5, { '5', '%' } },
+		{ Key::K6, { '6', '^' } }, { Key::K7, { '7', '&' } },
+		{ Key::K8, { '8', '*' } }, { Key::K9, { '9', '(' } },
+		{ Key::SEMICOLON, { ';', ':' } }, { Key::EQUAL, { '=', '+' } },
+		{ Key::A, { 'a', 'A' } }, { Key::B, { 'b', 'B' } },
+		{ Key::C, { 'c', 'C' } }, { Key::D, { 'd', 'D' } },
+		{ Key::E, { 'e', 'E' } }, { Key::F, { 'f', 'F' } },
+		{ Key::G, { 'g', 'G' } }, { Key::H, { 'h', 'H' } },
+		{ Key::I, { 'i', 'I' } }, { Key::J, { 'j', 'J' } },
+		{ Key::K, { 'k', 'K' } }, { Key::L, { 'l', 'L' } },
+		{ Key::M, { 'm', 'M' } }, { Key::N, { 'n', 'N' } },
+		{ Key::O, { 'o', 'O' } }, { Key::P, { 'p', 'P' } },
+		{ Key::Q, { 'q', 'Q' } }, { Key::R, { 'r', 'R' } },
+		{ Key::S, { 's', 'S' } }, { Key::T, { 't', 'T' } },
+		{ Key::U, { 'u', 'U' } }, { Key::V, { 'v', 'V' } },
+		{ Key::W, { 'w', 'W' } }, { Key::X, { 'x', 'X' } },
+		{ Key::Y, { 'y', 'Y' } }, { Key::Z, { 'z', 'Z' } },
+		{ Key::LEFT_BRACKET, { '[', '{' } }, { Key::BACKSLASH, { '\\', '|' } },
+		{ Key::RIGHT_BRACKET, { ']', '}' } },
+		{ Key::NP_0, { '0', '0' } }, { Key::NP_1, { '1', '1' } },
+		{ Key::NP_2, { '2', '2' } }, { Key::NP_3, { '3', '3' } },
+		{ Key::NP_4, { '4', '4' } }, { Key::NP_5, { '5', '5' } },
+		{ Key::NP_6, { '6', '6' } }, { Key::NP_7, { '7', '7' } },
+		{ Key::NP_8, { '8', '8' } }, { Key::NP_9, { '9', '9' } },
+		{ Key::NP_DIVIDE, { '/', '/' } }, { Key::NP_MULTIPLY, { '*', '*' } },
+		{ Key::NP_SUBTRACT, { '-', '-' } }, { Key::NP_ADD, { '+', '+' } },
+		{ Key::NP_EQUAL, { '=', '+' } }
+	};
+
+#ifdef PLATFORM_GLFW3
+
+	std::unordered_map<int, Key> GameEngine::s_KeysTable =
+	{
+		{ GLFW_KEY_SPACE, Key::SPACE }, { GLFW_KEY_APOSTROPHE, Key::APOSTROPHE }, { GLFW_KEY_COMMA, Key::COMMA },
+		{ GLFW_KEY_MINUS, Key::MINUS }, { GLFW_KEY_PERIOD, Key::PERIOD }, { GLFW_KEY_SLASH, Key::SLASH },
+
+		{ GLFW_KEY_0, Key::K0 }, { GLFW_KEY_1, Key::K1 }, { GLFW_KEY_2, Key::K2 }, { GLFW_KEY_3, Key::K3 }, { GLFW_KEY_4, Key::K4 },
+		{ GLFW_KEY_5, Key::K5 }, { GLFW_KEY_6, Key::K6 }, { GLFW_KEY_7, Key::K7 }, { GLFW_KEY_8, Key::K8 }, { GLFW_KEY_9, Key::K9 },
+
+		{ GLFW_KEY_SEMICOLON, Key::SEMICOLON }, { GLFW_KEY_EQUAL, Key::EQUAL },
+
+		{ GLFW_KEY_A, Key::A }, { GLFW_KEY_B, Key::B }, { GLFW_KEY_C, Key::C }, { GLFW_KEY_D, Key::D },
+		{ GLFW_KEY_E, Key::E }, { GLFW_KEY_F, Key::F }, { GLFW_KEY_G, Key::G }, { GLFW_KEY_H, Key::H },
+		{ GLFW_KEY_I, Key::I }, { GLFW_KEY_J, Key::J }, { GLFW_KEY_K, Key::K }, { GLFW_KEY_L, Key::L },
+		{ GLFW_KEY_M, Key::M }, { GLFW_KEY_N, Key::N }, { GLFW_KEY_O, Key::O }, { GLFW_KEY_P, Key::P },
+		{ GLFW_KEY_Q, Key::Q }, { GLFW_KEY_R, Key::R }, { GLFW_KEY_S, Key::S }, { GLFW_KEY_T, Key::T },
+		{ GLFW_KEY_U, Key::U }, { GLFW_KEY_V, Key::V }, { GLFW_KEY_W, Key::W }, { GLFW_KEY_X, Key::X },
+		{ GLFW_KEY_Y, Key::Y }, { GLFW_KEY_Z, Key::Z },
+		{ GLFW_KEY_LEFT_BRACKET, Key::LEFT_BRACKET }, { GLFW_KEY_BACKSLASH, Key::BACKSLASH }, { GLFW_KEY_RIGHT_BRACKET, Key::RIGHT_BRACKET },
+
+		{ GLFW_KEY_ESCAPE, Key::ESCAPE }, { GLFW_KEY_ENTER, Key::ENTER }, { GLFW_KEY_TAB, Key::TAB }, { GLFW_KEY_BACKSPACE, Key::BACKSPACE },
+		{ GLFW_KEY_INSERT, Key::INSERT }, { GLFW_KEY_DELETE, Key::DEL }, { GLFW_KEY_RIGHT, Key::RIGHT }, { GLFW_KEY_LEFT, Key::LEFT },
+		{ GLFW_KEY_DOWN, Key::DOWN }, { GLFW_KEY_UP, Key::UP }, { GLFW_KEY_PAGE_UP, Key::PAGE_UP }, { GLFW_KEY_PAGE_DOWN, Key::PAGE_DOWN },
+		{ GLFW_KEY_HOME, Key::HOME }, { GLFW_KEY_END, Key::END },
+		{ GLFW_KEY_CAPS_LOCK, Key::CAPS_LOCK }, { GLFW_KEY_SCROLL_LOCK, Key::SCROLL_LOCK }, { GLFW_KEY_NUM_LOCK, Key::NUM_LOCK },
+		{ GLFW_KEY_PRINT_SCREEN, Key::PRINT_SCREEN }, { GLFW_KEY_PAUSE, Key::PAUSE },
+
+		{ GLFW_KEY_F1, Key::F1 }, { GLFW_KEY_F2, Key::F2 }, { GLFW_KEY_F3, Key::F3 }, { GLFW_KEY_F4, Key::F4 }, { GLFW_KEY_F5, Key::F5 }, { GLFW_KEY_F6, Key::F6 },
+		{ GLFW_KEY_F7, Key::F7 }, { GLFW_KEY_F8, Key::F8 }, { GLFW_KEY_F9, Key::F9 }, { GLFW_KEY_F10, Key::F10 }, { GLFW_KEY_F11, Key::F11 }, { GLFW_KEY_F12, Key::F12 },
+		{ GLFW_KEY_F13, Key::F13 }, { GLFW_KEY_F14, Key::F14 }, { GLFW_KEY_F15, Key::F15 }, { GLFW_KEY_F16, Key::F16 }, { GLFW_KEY_F17, Key::F17 }, { GLFW_KEY_F18, Key::F18 },
+		{ GLFW_KEY_F19, Key::F19 }, { GLFW_KEY_F20, Key::F20 }, { GLFW_KEY_F21, Key::F21 }, { GLFW_KEY_F22, Key::F22 }, { GLFW_KEY_F23, Key::F23 }, { GLFW_KEY_F24, Key::F24 },
+
+		{ GLFW_KEY_KP_0, Key::NP_0 }, { GLFW_KEY_KP_1, Key::NP_1 }, { GLFW_KEY_KP_2, Key::NP_2 },
+		{ GLFW_KEY_KP_3, Key::NP_3 }, { GLFW_KEY_KP_4, Key::NP_4 }, { GLFW_KEY_KP_5, Key::NP_5 },
+		{ GLFW_KEY_KP_6, Key::NP_6 }, { GLFW_KEY_KP_7, Key::NP_7 }, { GLFW_KEY_KP_8, Key::NP_8 },
+		{ GLFW_KEY_KP_9, Key::NP_9 }, { GLFW_KEY_KP_DECIMAL, Key::NP_DECIMAL },
+		{ GLFW_KEY_KP_DIVIDE, Key::NP_DIVIDE }, { GLFW_KEY_KP_MULTIPLY, Key::NP_MULTIPLY },
+		{ GLFW_KEY_KP_SUBTRACT, Key::NP_SUBTRACT }, { GLFW_KEY_KP_ADD, Key::NP_ADD },
+		{ GLFW_KEY_KP_ENTER, Key::NP_ENTER }, { GLFW_KEY_KP_EQUAL, Key::NP_EQUAL },
+
+		{ GLFW_KEY_LEFT_SHIFT, Key::LEFT_SHIFT }, { GLFW_KEY_LEFT_CONTROL, Key::LEFT_CONTROL },
+		{ GLFW_KEY_LEFT_ALT, Key::LEFT_ALT }, { GLFW_KEY_LEFT_SUPER, Key::LEFT_SUPER },
+		{ GLFW_KEY_RIGHT_SHIFT, Key::RIGHT_SHIFT }, { GLFW_KEY_RIGHT_CONTROL, Key::RIGHT_CONTROL },
+		{ GLFW_KEY_RIGHT_ALT, Key::RIGHT_ALT }, { GLFW_KEY_RIGHT_SUPER, Key::RIGHT_SUPER }, { GLFW_KEY_MENU, Key::MENU },
+
+		{ GLFW_KEY_UNKNOWN, Key::NONE }
+	};
+
+#endif
+
+#ifdef PLATFORM_EMSCRIPTEN
+
+	std::unordered_map<int, Key> GameEngine::s_KeysTable =
+	{
+		{ DOM_PK_SPACE, Key::SPACE }, { DOM_PK_QUOTE, Key::APOSTROPHE }, { DOM_PK_COMMA, Key::COMMA },
+		{ DOM_PK_MINUS, Key::MINUS }, { DOM_PK_PERIOD, Key::PERIOD }, { DOM_PK_SLASH, Key::SLASH },
+
+		{ DOM_PK_0, Key::K0 }, { DOM_PK_1, Key::K1 }, { DOM_PK_2, Key::K2 }, { DOM_PK_3, Key::K3 }, { DOM_PK_4, Key::K4 },
+		{ DOM_PK_5, Key::K5 }, { DOM_PK_6, Key::K6 }, { DOM_PK_7, Key::K7 }, { DOM_PK_8, Key::K8 }, { DOM_PK_9, Key::K9 },
+
+		{ DOM_PK_SEMICOLON, Key::SEMICOLON }, { DOM_PK_EQUAL, Key::EQUAL },
+
+		{ DOM_PK_A, Key::A }, { DOM_PK_B, Key::B }, { DOM_PK_C, Key::C }, { DOM_PK_D, Key::D },
+		{ DOM_PK_E, Key::E }, { DOM_PK_F, Key::F }, { DOM_PK_G, Key::G }, { DOM_PK_H, Key::H },
+		{ DOM_PK_I, Key::I }, { DOM_PK_J, Key::J }, { DOM_PK_K, Key::K }, { DOM_PK_L, Key::L },
+		{ DOM_PK_M, Key::M }, { DOM_PK_N, Key::N }, { DOM_PK_O, Key::O }, { DOM_PK_P, Key::P },
+		{ DOM_PK_Q, Key::Q }, { DOM_PK_R, Key::R }, { DOM_PK_S, Key::S }, { DOM_PK_T, Key::T },
+		{ DOM_PK_U, Key::U }, { DOM_PK_V, Key::V }, { DOM_PK_W, Key::W }, { DOM_PK_X, Key::X },
+		{ DOM_PK_Y, Key::Y }, { DOM_PK_Z, Key::Z },
+
+		{ DOM_PK_BRACKET_LEFT, Key::LEFT_BRACKET }, { DOM_PK_BACKSLASH, Key::BACKSLASH }, { DOM_PK_BRACKET_RIGHT, Key::RIGHT_BRACKET },
+
+		{ DOM_PK_ESCAPE, Key::ESCAPE }, { DOM_PK_ENTER, Key::ENTER }, { DOM_PK_TAB, Key::TAB }, { DOM_PK_BACKSPACE, Key::BACKSPACE },
+		{ DOM_PK_INSERT, Key::INSERT }, { DOM_PK_DELETE, Key::DEL }, { DOM_PK_ARROW_RIGHT, Key::RIGHT }, { DOM_PK_ARROW_LEFT, Key::LEFT },
+		{ DOM_PK_ARROW_DOWN, Key::DOWN }, { DOM_PK_ARROW_UP, Key::UP }, { DOM_PK_PAGE_UP, Key::PAGE_UP }, { DOM_PK_PAGE_DOWN, Key::PAGE_DOWN },
+		{ DOM_PK_HOME, Key::HOME }, { DOM_PK_END, Key::END },
+		{ DOM_PK_CAPS_LOCK, Key::CAPS_LOCK }, { DOM_PK_SCROLL_LOCK, Key::SCROLL_LOCK }, { DOM_PK_NUM_LOCK, Key::NUM_LOCK },
+		{ DOM_PK_PRINT_SCREEN, Key::PRINT_SCREEN }, { DOM_PK_PAUSE, Key::PAUSE },
+
+		{ DOM_PK_F1, Key::F1 }, { DOM_PK_F2, Key::F2 }, { DOM_PK_F3, Key::F3 }, { DOM_PK_F4, Key::F4 }, { DOM_PK_F5, Key::F5 }, { DOM_PK_F6, Key::F6 },
+		{ DOM_PK_F7, Key::F7 }, { DOM_PK_F8, Key::F8 }, { DOM_PK_F9, Key::F9 }, { DOM_PK_F10, Key::F10 }, { DOM_PK_F11, Key::F11 }, { DOM_PK_F12, Key::F12 },
+		{ DOM_PK_F13, Key::F13 }, { DOM_PK_F14, Key::F14 }, { DOM_PK_F15, Key::F15 }, { DOM_PK_F16, Key::F16 }, { DOM_PK_F17, Key::F17 }, { DOM_PK_F18, Key::F18 },
+		{ DOM_PK_F19, Key::F19 }, { DOM_PK_F20, Key::F20 }, { DOM_PK_F21, Key::F21 }, { DOM_PK_F22, Key::F22 }, { DOM_PK_F23, Key::F23 }, { DOM_PK_F24, Key::F24 },
+
+		{ DOM_PK_NUMPAD_0, Key::NP_0 }, { DOM_PK_NUMPAD_1, Key::NP_1 }, { DOM_PK_NUMPAD_2, Key::NP_2 },
+		{ DOM_PK_NUMPAD_3, Key::NP_3 }, { DOM_PK_NUMPAD_4, Key::NP_4 }, { DOM_PK_NUMPAD_5, Key::NP_5 },
+		{ DOM_PK_NUMPAD_6, Key::NP_6 }, { DOM_PK_NUMPAD_7, Key::NP_7 }, { DOM_PK_NUMPAD_8, Key::NP_8 },
+		{ DOM_PK_NUMPAD_9, Key::NP_9 }, { DOM_PK_NUMPAD_DECIMAL, Key::NP_DECIMAL },
+		{ DOM_PK_NUMPAD_DIVIDE, Key::NP_DIVIDE }, { DOM_PK_NUMPAD_MULTIPLY, Key::NP_MULTIPLY },
+		{ DOM_PK_NUMPAD_SUBTRACT, Key::NP_SUBTRACT }, { DOM_PK_NUMPAD_ADD, Key::NP_ADD },
+		{ DOM_PK_NUMPAD_ENTER, Key::NP_ENTER }, { DOM_PK_NUMPAD_EQUAL, Key::NP_EQUAL },
+
+		{ DOM_PK_SHIFT_LEFT, Key::LEFT_SHIFT }, { DOM_PK_CONTROL_LEFT, Key::LEFT_CONTROL },
+		{ DOM_PK_ALT_LEFT, Key::LEFT_ALT }, { DOM_PK_OS_LEFT, Key::LEFT_SUPER },
+		{ DOM_PK_SHIFT_RIGHT, Key::RIGHT_SHIFT }, { DOM_PK_CONTROL_RIGHT, Key::RIGHT_CONTROL },
+		{ DOM_PK_ALT_RIGHT, Key::RIGHT_ALT }, { DOM_PK_OS_RIGHT, Key::RIGHT_SUPER }, { DOM_PK_CONTEXT_MENU, Key::MENU },
+
+		{ DOM_PK_UNKNOWN, Key::NONE }
+	};
+
+#endif
+
+	GameEngine* GameEngine::s_Engine = nullptr;
+
+	std::string Pixel::str() const
+	{
+		return "(" + std::to_string(r) + ", " + std::to_string(g) + ", " + std::to_string(b) + ", " + std::to_string(a) + ")";
+	}
+
+	void Pixel::BlendSpan(Pixel* dest, const Pixel& col, size_t count)
+	{
+		if (col.a == 255)
+		{
+			std::fill(dest, dest + count, col);
+			return;
+		}
+
+		size_t i = 0;
+
+		// The same math as in Blend on 16-bit lanes: the channels are unpacked,
+		// multiplied, divided by 255 and packed back with the alpha set to 255
+
+#ifdef DGE_SIMD_AVX2
+		{
+			const __m256i zero = _mm256_setzero_si256();
+			const __m256i opaque = _mm256_set1_epi32((int)Pixel(0, 0, 0, 255).rgba_n);
+			const __m256i inverse = _mm256_set1_epi16(short(255 - col.a));
+
+			const __m256i source = _mm256_setr_epi16(
+				short(col.r * col.a + 128), short(col.g * col.a + 128), short(col.b * col.a + 128), 0,
+				short(col.r * col.a + 128), short(col.g * col.a + 128), short(col.b * col.a + 128), 0,
+				short(col.r * col.a + 128), short(col.g * col.a + 128), short(col.b * col.a + 128), 0,
+				short(col.r * col.a + 128), short(col.g * col.a + 128), short(col.b * col.a + 128), 0);
+
+			for (; i + 8 <= count; i += 8)
+			{
+				__m256i d = _mm256_loadu_si256((const __m256i*)(dest + i));
+
+				__m256i lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero), inverse), source);
+				__m256i hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero), inverse), source);
+
+				lo = _mm256_srli_epi16(_mm256_add_epi16(lo, _mm256_srli_epi16(lo, 8)), 8);
+				hi = _mm256_srli_epi16(_mm256_add_epi16(hi, _mm256_srli_epi16(hi, 8)), 8);
+
+				_mm256_storeu_si256((__m256i*)(dest + i), _mm256_or_si256(_mm256_packus_epi16(lo, hi), opaque));
+			}
+		}
+#endif
+
+#ifdef DGE_SIMD_SSE2
+		{
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i opaque = _mm_set1_epi32((int)Pixel(0, 0, 0, 255).rgba_n);
+			const __m128i inverse = _mm_set1_epi16(short(255 - col.a));
+
+			const __m128i source = _mm_setr_epi16(
+				short(col.r * col.a + 128), short(col.g * col.a + 128), short(col.b * col.a + 128), 0,
+				short(col.r * col.a + 128), short(col.g * col.a + 128), short(col.b * col.a + 128), 0);
+
+			for (; i + 4 <= count; i += 4)
+			{
+				__m128i d = _mm_loadu_si128((const __m128i*)(dest + i));
+
+				__m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), inverse), source);
+				__m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), inverse), source);
+
+				lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+				hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+
+				_mm_storeu_si128((__m128i*)(dest + i), _mm_or_si128(_mm_packus_epi16(lo, hi), opaque));
+			}
+		}
+#endif
+
+		for (; i < count; i++)
+			dest[i] = Blend(dest[i], col);
+	}
+
+	void Pixel::BlendSpan(Pixel* dest, const Pixel* src, size_t count)
+	{
+		size_t i = 0;
+
+		// Like the span of one colour but the alpha of every source pixel
+		// is copied to the lanes of its channels with the shuffles
+
+#ifdef DGE_SIMD_AVX2
+		{
+			const __m256i zero = _mm256_setzero_si256();
+			const __m256i opaque = _mm256_set1_epi32((int)Pixel(0, 0, 0, 255).rgba_n);
+			const __m256i full = _mm256_set1_epi16(255);
+			const __m256i half = _mm256_set1_epi16(128);
+
+			auto blend = [&](__m256i d, __m256i s)
+				{
+					__m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, 0xFF), 0xFF);
+
+					__m256i t = _mm256_add_epi16(_mm256_mullo_epi16(d, _mm256_sub_epi16(full, a)), _mm256_mullo_epi16(s, a));
+					t = _mm256_add_epi16(t, half);
+
+					return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+				};
+
+			for (; i + 8 <= count; i += 8)
+			{
+				__m256i d = _mm256_loadu_si256((const __m256i*)(dest + i));
+				__m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+
+				__m256i lo = blend(_mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi8(s, zero));
+				__m256i hi = blend(_mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi8(s, zero));
+
+				_mm256_storeu_si256((__m256i*)(dest + i), _mm256_or_si256(_mm256_packus_epi16(lo, hi), opaque));
+			}
+		}
+#endif
+
+#ifdef DGE_SIMD_SSE2
+		{
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i opaque = _mm_set1_epi32((int)Pixel(0, 0, 0, 255).rgba_n);
+			const __m128i full = _mm_set1_epi16(255);
+			const __m128i half = _mm_set1_epi16(128);
+
+			auto blend = [&](__m128i d, __m128i s)
+				{
+					__m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, 0xFF), 0xFF);
+
+					__m128i t = _mm_add_epi16(_mm_mullo_epi16(d, _mm_sub_epi16(full, a)), _mm_mullo_epi16(s, a));
+					t = _mm_add_epi16(t, half);
+
+					return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+				};
+
+			for (; i + 4 <= count; i += 4)
+			{
+				__m128i d = _mm_loadu_si128((const __m128i*)(dest + i));
+				__m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+
+				__m128i lo = blend(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(s, zero));
+				__m128i hi = blend(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(s, zero));
+
+				_mm_storeu_si128((__m128i*)(dest + i), _mm_or_si128(_mm_packus_epi16(lo, hi), opaque));
+			}
+		}
+#endif
+
+		for (; i < count; i++)
+			dest[i] = Blend(dest[i], src[i]);
+	}
+
+	void Pixel::MaskSpan(Pixel* dest, const Pixel* src, size_t count)
+	{
+		size_t i = 0;
+
+#ifdef DGE_SIMD_AVX2
+		{
+			const __m256i alpha = _mm256_set1_epi32((int)Pixel(0, 0, 0, 255).rgba_n);
+
+			for (; i + 8 <= count; i += 8)
+			{
+				__m256i d = _mm256_loadu_si256((const __m256i*)(dest + i));
+				__m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+
+				__m256i opaque = _mm256_cmpeq_epi32(_mm256_and_si256(s, alpha), alpha);
+				_mm256_storeu_si256((__m256i*)(dest + i), _mm256_blendv_epi8(d, s, opaque));
+			}
+		}
+#endif
+
+#ifdef DGE_SIMD_SSE2
+		{
+			const __m128i alpha = _mm_set1_epi32((int)Pixel(0, 0, 0, 255).rgba_n);
+
+			for (; i + 4 <= count; i += 4)
+			{
+				__m128i d = _mm_loadu_si128((const __m128i*)(dest + i));
+				__m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+
+				__m128i opaque = _mm_cmpeq_epi32(_mm_and_si128(s, alpha), alpha);
+				_mm_storeu_si128((__m128i*)(dest + i), _mm_or_si128(_mm_and_si128(opaque, s), _mm_andnot_si128(opaque, d)));
+			}
+		}
+#endif
+
+		for (; i < count; i++)
+		{
+			if (src[i].a == 255)
+				dest[i] = src[i];
+		}
+	}
+
+	Pixel Pixel::Bilinear(const Pixel& tl, const Pixel& tr, const Pixel& bl, const Pixel& br, int offsetX, int offsetY)
+	{
+		// The columns are interpolated first and halved so they fit into 16 bits,
+		// then the rows are interpolated and scaled back by 2^15
+
+#ifdef DGE_SIMD_SSE2
+		const __m128i zero = _mm_setzero_si128();
+
+		__m128i top = _mm_unpacklo_epi8(_mm_unpacklo_epi32(_mm_cvtsi32_si128((int)tl.rgba_n), _mm_cvtsi32_si128((int)tr.rgba_n)), zero);
+		__m128i bottom = _mm_unpacklo_epi8(_mm_unpacklo_epi32(_mm_cvtsi32_si128((int)bl.rgba_n), _mm_cvtsi32_si128((int)br.rgba_n)), zero);
+
+		__m128i weightsY = _mm_set1_epi32((offsetY << 16) | (256 - offsetY));
+		__m128i weightsX = _mm_set1_epi32((offsetX << 16) | (256 - offsetX));
+
+		__m128i left = _mm_srli_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(top, bottom), weightsY), 1);
+		__m128i right = _mm_srli_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(top, bottom), weightsY), 1);
+
+		__m128i columns = _mm_packs_epi32(left, right);
+		__m128i sum = _mm_madd_epi16(_mm_unpacklo_epi16(columns, _mm_srli_si128(columns, 8)), weightsX);
+
+		sum = _mm_srli_epi32(_mm_add_epi32(sum, _mm_set1_epi32(1 << 14)), 15);
+		sum = _mm_packs_epi32(sum, sum);
+
+		return Pixel((uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(sum, sum)));
+#else
+		auto lerp = [offsetX, offsetY](int tl, int tr, int bl, int br)
+			{
+				int left = (tl * (256 - offsetY) + bl * offsetY) >> 1;
+				int right = (tr * (256 - offsetY) + br * offsetY) >> 1;
+
+				return uint8_t((left * (256 - offsetX) + right * offsetX + (1 << 14)) >> 15);
+			};
+
+		return Pixel(
+			lerp(tl.r, tr.r, bl.r, br.r),
+			lerp(tl.g, tr.g, bl.g, br.g),
+			lerp(tl.b, tr.b, bl.b, br.b),
+			lerp(tl.a, tr.a, bl.a, br.a));
+#endif
+	}
+
+	Pixel Pixel::Bicubic(const Pixel* taps, const float* weightsX, const float* weightsY)
+	{
+#ifdef DGE_SIMD_SSE2
+		const __m128i zero = _mm_setzero_si128();
+
+		__m128 sum = _mm_setzero_ps();
+
+		for (int y = 0; y < 4; y++)
+		{
+			__m128 row = _mm_setzero_ps();
+
+			for (int x = 0; x < 4; x++)
+			{
+				__m128i channels = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128((int)taps[y * 4 + x].rgba_n), zero), zero);
+				row = _mm_add_ps(row, _mm_mul_ps(_mm_cvtepi32_ps(channels), _mm_set1_ps(weightsX[x])));
+			}
+
+			sum = _mm_add_ps(sum, _mm_mul_ps(row, _mm_set1_ps(weightsY[y])));
+		}
+
+		sum = _mm_min_ps(_mm_max_ps(sum, _mm_setzero_ps()), _mm_set1_ps(255.0f));
+
+		__m128i result = _mm_cvttps_epi32(sum);
+		result = _mm_packs_epi32(result, result);
+
+		return Pixel((uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(result, result)));
+#else
+		float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+		for (int y = 0; y < 4; y++)
+		{
+			float row[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+			for (int x = 0; x < 4; x++)
+			{
+				const Pixel& p = taps[y * 4 + x];
+
+				row[0] += (float)p.r * weightsX[x];
+				row[1] += (float)p.g * weightsX[x];
+				row[2] += (float)p.b * weightsX[x];
+				row[3] += (float)p.a * weightsX[x];
+			}
+
+			for (int i = 0; i < 4; i++)
+				sum[i] += row[i] * weightsY[y];
+		}
+
+		return Pixel(
+			(uint8_t)std::clamp(sum[0], 0.0f, 255.0f),
+			(uint8_t)std::clamp(sum[1], 0.0f, 255.0f),
+			(uint8_t)std::clamp(sum[2], 0.0f, 255.0f),
+			(uint8_t)std::clamp(sum[3], 0.0f, 255.0f));
+#endif
+	}
+
+	void Pixel::Downsample(const Pixel* top, const Pixel* bottom, Pixel* dest, size_t count)
+	{
+		size_t i = 0;
+
+#ifdef DGE_SIMD_SSE2
+		{
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i round = _mm_set1_epi16(2);
+
+			// Adds the rows of a pair of destination pixels and then the columns of each of them
+			auto sumPair = [zero](__m128i top, __m128i bottom)
+				{
+					__m128i left = _mm_add_epi16(_mm_unpacklo_epi8(top, zero), _mm_unpacklo_epi8(bottom, zero));
+					__m128i right = _mm_add_epi16(_mm_unpackhi_epi8(top, zero), _mm_unpackhi_epi8(bottom, zero));
+
+					return _mm_add_epi16(_mm_unpacklo_epi64(left, right), _mm_unpackhi_epi64(left, right));
+				};
+
+			for (; i + 4 <= count; i += 4)
+			{
+				__m128i low = sumPair(
+					_mm_loadu_si128((const __m128i*)(top + i * 2)),
+					_mm_loadu_si128((const __m128i*)(bottom + i * 2)));
+
+				__m128i high = sumPair(
+					_mm_loadu_si128((const __m128i*)(top + i * 2 + 4)),
+					_mm_loadu_si128((const __m128i*)(bottom + i * 2 + 4)));
+
+				low = _mm_srli_epi16(_mm_add_epi16(low, round), 2);
+				high = _mm_srli_epi16(_mm_add_epi16(high, round), 2);
+
+				_mm_storeu_si128((__m128i*)(dest + i), _mm_packus_epi16(low, high));
+			}
+		}
+#endif
+
+		for (; i < count; i++)
+		{
+			const Pixel& tl = top[i * 2];
+			const Pixel& tr = top[i * 2 + 1];
+			const Pixel& bl = bottom[i * 2];
+			const Pixel& br = bottom[i * 2 + 1];
+
+			dest[i] = Pixel(
+				uint8_t((tl.r + tr.r + bl.r + br.r + 2) >> 2),
+				uint8_t((tl.g + tr.g + bl.g + br.g + 2) >> 2),
+				uint8_t((tl.b + tr.b + bl.b + br.b + 2) >> 2),
+				uint8_t((tl.a + tr.a + bl.a + br.a + 2) >> 2));
+		}
+	}
+
+	Sprite::Sprite(const vi2d& size)
+	{
+		Create(size);
+	}
+
+	Sprite::Sprite(std::string_view fileName)
+	{
+		Load(fileName);
+	}
+
+	Sprite::~Sprite()
+	{
+		FlushRecorded();
+	}
+
+	void Sprite::Create(const vi2d& size)
+	{
+		Assert(size.x > 0 && size.y > 0, "[Sprite.Create Error] Width and height should be > 0");
+
+		FlushRecorded();
+
+		pixels.clear();
+		this->size = size;
+
+		pixels.resize(size.x * size.y);
+		std::fill(pixels.begin(), pixels.end(), BLACK);
+
+		MarkDirty();
+		m_Content = Content::OPAQUE;
+	}
+
+	void Sprite::Load(std::string_view fileName)
+	{
+		Assert(TryLoad(fileName), "[Sprite.Load Error] Can't load a file: ", fileName.data());
+	}
+
+	bool Sprite::TryLoad(std::string_view fileName)
+	{
+		FlushRecorded();
+
+		std::ifstream file(fileName.data(), std::ios::binary);
+
+		RawHeader header;
+
+		if (file.read((char*)&header, sizeof(header)) && std::memcmp(header.magic, "DGES", 4) == 0)
+		{
+			if (!LoadRaw(file, header))
+				return false;
+		}
+		else
+		{
+			int width, height;
+
+			if (stbi_is_hdr(fileName.data()))
+				return false;
+
+			uint8_t* data = stbi_load(fileName.data(), &width, &height, NULL, 4);
+
+			if (!data)
+				return false;
+
+			size = { width, height };
+
+			pixels.clear();
+			pixels.resize(size.x * size.y);
+
+			// stb_image writes the channels in the same order as they are stored in Pixel
+			std::memcpy(pixels.data(), data, pixels.size() * sizeof(Pixel));
+
+			stbi_image_free(data);
+		}
+
+		MarkDirty();
+		m_Content = Content::UNKNOWN;
+
+		return true;
+	}
+
+	void Sprite::Save(std::string_view fileName, const FileType type) const
+	{
+		int err = 0;
+
+		switch (type)
+		{
+		case FileType::RAW: SaveRaw(fileName, false); return;
+		case FileType::RAW_LZ: SaveRaw(fileName, true); return;
+
+		case FileType::BMP: err = stbi_write_bmp(fileName.data(), size.x, size.y, 4, pixels.data()); break;
+		case FileType::PNG: err = stbi_write_png(fileName.data(), size.x, size.y, 4, pixels.data(), size.x * 4); break;
+		case FileType::JPG: err = stbi_write_jpg(fileName.data(), size.x, size.y, 4, pixels.data(), 100); break;
+		case FileType::TGA: err = stbi_write_tga(fileName.data(), size.x, size.y, 4, pixels.data()); break;
+		case FileType::TGA_RLE:
+		{
+			stbi_write_tga_with_rle = 1;
+			err = stbi_write_tga(fileName.data(), size.x, size.y, 4, pixels.data());
+			stbi_write_tga_with_rle = 0;
+		}
+		break;
+
+		}
+
+		Assert(err == 1, "[stb_image_write Error] Code: ", std::to_string(err).c_str());
+	}
+
+	bool Sprite::LoadRaw(std::ifstream& file, const RawHeader& header)
+	{
+		if (header.version != 1 || header.width <= 0 || header.height <= 0)
+			return false;
+
+		std::streamoff payloadStart = file.tellg();
+		file.seekg(0, std::ios::end);
+
+		// The payload fills the rest of the file so a broken header can't ask for more memory than the file has
+		if (file.tellg() - payloadStart != (std::streamoff)header.payloadSize)
+			return false;
+
+		file.seekg(payloadStart);
+
+		size_t length = (size_t)header.width * (size_t)header.height * sizeof(Pixel);
+		std::vector<Pixel> data;
+
+		if (header.flags & 1)
+		{
+			// A sequence can't unpack into more than 255 bytes for each of its bytes
+			if (length / 255 > header.payloadSize)
+				return false;
+
+			std::vector<uint8_t> payload(header.payloadSize);
+
+			if (!file.read((char*)payload.data(), payload.size()))
+				return false;
+
+			data.resize(length / sizeof(Pixel));
+
+			if (!DecompressLZ(payload.data(), payload.size(), (uint8_t*)data.data(), length))
+				return false;
+		}
+		else
+		{
+			if (header.payloadSize != length)
+				return false;
+
+			// The pixels are read straight into place
+			data.resize(length / sizeof(Pixel));
+
+			if (!file.read((char*)data.data(), length))
+				return false;
+		}
+
+		size = { header.width, header.height };
+		pixels = std::move(data);
+
+		return true;
+	}
+
+	void Sprite::SaveRaw(std::string_view fileName, bool compress) const
+	{
+		std::ofstream file(fileName.data(), std::ios::binary);
+		Assert(file.is_open(), "[Sprite.Save Error] Can't open a file: ", fileName.data());
+
+		const uint8_t* data = (const uint8_t*)pixels.data();
+		size_t length = pixels.size() * sizeof(Pixel);
+
+		std::vector<uint8_t> compressed;
+
+		// The pixels are stored as they are if compressing them doesn't help
+		if (compress)
+		{
+			compressed = CompressLZ(data, length);
+			compress = compressed.size() < length;
+		}
+
+		RawHeader header{ { 'D', 'G', 'E', 'S' }, 1, uint16_t(compress ? 1 : 0), size.x, size.y, uint32_t(compress ? compressed.size() : length) };
+
+		file.write((const char*)&header, sizeof(header));
+		file.write(compress ? (const char*)compressed.data() : (const char*)data, header.payloadSize);
+
+		Assert(file.good(), "[Sprite.Save Error] Can't write a file: ", fileName.data());
+	}
+
+	std::vector<uint8_t> Sprite::CompressLZ(const uint8_t* src, size_t size)
+	{
+		const int hashBits = 16;
+
+		// Positions + 1 of the last 4 bytes with the same hash, 0 is empty
+		std::vector<uint32_t> table(1 << hashBits, 0);
+
+		std::vector<uint8_t> out;
+		out.reserve(size / 2);
+
+		auto hash = [src](size_t i)
+			{
+				uint32_t value;
+				std::memcpy(&value, src + i, 4);
+				return (value * 2654435761u) >> (32 - hashBits);
+			};
+
+		auto writeLength = [&out](size_t length)
+			{
+				for (; length >= 255; length -= 255)
+					out.push_back(255);
+
+				out.push_back((uint8_t)length);
+			};
+
+		size_t anchor = 0;
+
+		// A sequence is a token with the lengths of the literals and of the match, the literals,
+		// the offset of the match and the rest of the lengths that didn't fit into the token.
+		// The last sequence has only the literals
+		auto writeSequence = [&](size_t position, size_t offset, size_t match)
+			{
+				size_t literals = position - anchor;
+				size_t matchCode = match > 0 ? match - 4 : 0;
+
+				out.push_back(uint8_t((std::min<size_t>(literals, 15) << 4) | std::min<size_t>(matchCode, 15)));
+
+				if (literals >= 15)
+					writeLength(literals - 15);
+
+				out.insert(out.end(), src + anchor, src + position);
+
+				if (match > 0)
+				{
+					out.push_back(uint8_t(offset & 0xFF));
+					out.push_back(uint8_t(offset >> 8));
+
+					if (matchCode >= 15)
+						writeLength(matchCode - 15);
+				}
+			};
+
+		for (size_t i = 0; i + 4 <= size;)
+		{
+			uint32_t h = hash(i);
+
+			size_t candidate = table[h];
+			table[h] = uint32_t(i + 1);
+
+			if (candidate == 0 || i + 1 - candidate > 0xFFFF || std::memcmp(src + candidate - 1, src + i, 4) != 0)
+			{
+				i++;
+				continue;
+			}
+
+			candidate--;
+
+			size_t match = 4;
+			while (i + match < size && src[candidate + match] == src[i + match])
+				match++;
+
+			writeSequence(i, i - candidate, match);
+
+			i += match;
+			anchor = i;
+		}
+
+		writeSequence(size, 0, 0);
+
+		return out;
+	}
+
+	bool Sprite::DecompressLZ(const uint8_t* src, size_t srcSize, uint8_t* dest, size_t destSize)
+	{
+		const uint8_t* srcEnd = src + srcSize;
+
+		uint8_t* start = dest;
+		uint8_t* destEnd = dest + destSize;
+
+		auto readLength = [&src, srcEnd](size_t& length)
+			{
+				for (uint8_t byte = 255; byte == 255; length += byte)
+				{
+					if (src == srcEnd)
+						return false;
+
+					byte = *src++;
+				}
+
+				return true;
+			};
+
+		while (src < srcEnd)
+		{
+			uint8_t token = *src++;
+
+			size_t literals = token >> 4;
+
+			if (literals == 15 && !readLength(literals))
+				return false;
+
+			if (literals > size_t(srcEnd - src) || literals > size_t(destEnd - dest))
+				return false;
+
+			std::memcpy(dest, src, literals);
+			src += literals;
+			dest += literals;
+
+			if (src == srcEnd)
+				break;
+
+			if (srcEnd - src < 2)
+				return false;
+
+			size_t offset = src[0] | (src[1] << 8);
+			src += 2;
+
+			size_t match = token & 15;
+
+			if (match == 15 && !readLength(match))
+				return false;
+
+			match += 4;
+
+			if (offset == 0 || offset > size_t(dest - start) || match > size_t(destEnd - dest))
+				return false;
+
+			const uint8_t* from = dest - offset;
+
+			// A match that overlaps with itself repeats every offset bytes,
+			// so the copied part doubles every time without overlapping the source
+			for (size_t copied = 0; copied < match;)
+			{
+				size_t chunk = std::min(offset + copied, match - copied);
+				std::memcpy(dest + copied, from, chunk);
+				copied += chunk;
+			}
+
+			dest += match;
+		}
+
+		return dest == destEnd;
+	}
+
+	bool Sprite::SetPixel(int x, int y, const Pixel& col)
+	{
+		if (x >= 0 && y >= 0 && x < size.x && y < size.y)
+		{
+			FlushRecorded();
+
+			pixels[y * size.x + x] = col;
+			ExpandDirty(x, y, x + 1, y + 1);
+
+			if (m_Content != GetContent(col))
+				m_Content = Content::UNKNOWN;
+
+			return true;
+		}
+
+		return false;
+	}
+
+	bool Sprite::SetPixel(const vi2d& pos, const Pixel& col)
+	{
+		return SetPixel(pos.x, pos.y, col);
+	}
+
+	Pixel Sprite::GetPixel(int x, int y, const WrapMethod wrap) const
+	{
+		auto GetPixel = [&pixels = pixels, &size = size](int x, int y)
+			{
+				return pixels[y * size.x + x];
+			};
+
+		switch (wrap)
+		{
+		case WrapMethod::NONE:
+		{
+			if (x >= 0 && y >= 0 && x < size.x && y < size.y)
+				return GetPixel(x, y);
+		}
+		break;
+
+		case WrapMethod::REPEAT:
+			return GetPixel(abs(x) % size.x, abs(y) % size.y);
+
+		case WrapMethod::MIRROR:
+		{
+			int mx = (x < 0) ? size.x - 1 - abs(x) % size.x : abs(x) % size.x;
+			int my = (y < 0) ? size.y - 1 - abs(y) % size.y : abs(y) % size.y;
+
+			return GetPixel(mx, my);
+		}
+
+		case WrapMethod::CLAMP:
+		{
+			int cx = std::clamp(x, 0, size.x - 1);
+			int cy = std::clamp(y, 0, size.y - 1);
+
+			return GetPixel(cx, cy);
+		}
+
+		}
+
+		return BLACK;
+	}
+
+	Pixel Sprite::GetPixel(const vi2d& pos, const WrapMethod wrap) const
+	{
+		return GetPixel(pos.x, pos.y, wrap);
+	}
+
+	void Sprite::SetPixelData(const Pixel& col)
+	{
+		FlushRecorded();
 
-			return Pixel(
-				(uint8_t)std::clamp(pix.r, 0.0f, 255.0f),
-				(uint8_t)std::clamp(pix.g, 0.0f, 255.0f),
-				(uint8_t)std::clamp(pix.b, 0.0f, 255.0f),
-				(uint8_t)std::clamp(pix.a, 0.0f, 255.0f)
-			);
+		std::fill(pixels.begin(), pixels.end(), col);
+
+		MarkDirty();
+		m_Content = GetContent(col);
+	}
+
+	Pixel Sprite::Sample(float x, float y, const SampleMethod sample, const WrapMethod wrap, float lod) const
+	{
+		return Sample({ x, y }, sample, wrap, lod);
+	}
+
+	Pixel Sprite::Sample(const vf2d& pos, const SampleMethod sample, const WrapMethod wrap, float lod) const
+	{
+		Pixel out;
+		SampleBatch(&pos, &out, 1, sample, wrap, lod);
+		return out;
+	}
+
+	void Sprite::SampleBatch(const vf2d* uvs, Pixel* out, size_t count, const SampleMethod sample, const WrapMethod wrap, float lod) const
+	{
+		if (sample == SampleMethod::TRILINEAR)
+		{
+			lod = std::clamp(lod, 0.0f, float(GetMipLevelsCount() - 1));
+
+			int level = (int)lod;
+			int blend = int((lod - (float)level) * 256.0f);
+
+			GetMipLevel(level)->SampleBatch(uvs, out, count, SampleMethod::BILINEAR, wrap);
+
+			if (blend == 0)
+				return;
+
+			const Sprite* next = GetMipLevel(level + 1);
+			Pixel coarse[64];
+
+			// The next level is sampled in chunks and blended into the output
+			for (size_t i = 0; i < count; i += 64)
+			{
+				size_t chunk = std::min<size_t>(64, count - i);
+				next->SampleBatch(uvs + i, coarse, chunk, SampleMethod::BILINEAR, wrap);
+
+				for (size_t j = 0; j < chunk; j++)
+					out[i + j] = Pixel::Bilinear(out[i + j], coarse[j], out[i + j], coarse[j], blend, 0);
+			}
+
+			return;
+		}
+
+		switch (wrap)
+		{
+		case WrapMethod::NONE: SampleBatch<WrapMethod::NONE>(uvs, out, count, sample); break;
+		case WrapMethod::REPEAT: SampleBatch<WrapMethod::REPEAT>(uvs, out, count, sample); break;
+		case WrapMethod::MIRROR: SampleBatch<WrapMethod::MIRROR>(uvs, out, count, sample); break;
+		case WrapMethod::CLAMP: SampleBatch<WrapMethod::CLAMP>(uvs, out, count, sample); break;
+		}
+	}
+
+	template <Sprite::WrapMethod wrap>
+	const Pixel& Sprite::GetTap(int x, int y) const
+	{
+		// The same rules as in GetPixel
+		if constexpr (wrap == WrapMethod::NONE)
+		{
+			if (x < 0 || y < 0 || x >= size.x || y >= size.y)
+				return BLACK;
+		}
+
+		if constexpr (wrap == WrapMethod::REPEAT)
+		{
+			x = abs(x) % size.x;
+			y = abs(y) % size.y;
+		}
+
+		if constexpr (wrap == WrapMethod::MIRROR)
+		{
+			x = (x < 0) ? size.x - 1 - abs(x) % size.x : abs(x) % size.x;
+			y = (y < 0) ? size.y - 1 - abs(y) % size.y : abs(y) % size.y;
+		}
+
+		if constexpr (wrap == WrapMethod::CLAMP)
+		{
+			x = std::clamp(x, 0, size.x - 1);
+			y = std::clamp(y, 0, size.y - 1);
+		}
+
+		return pixels[y * size.x + x];
+	}
+
+	template <Sprite::WrapMethod wrap>
+	void Sprite::SampleBatch(const vf2d* uvs, Pixel* out, size_t count, const SampleMethod sample) const
+	{
+		vf2d scale = size;
+
+		switch (sample)
+		{
+		case SampleMethod::LINEAR:
+		{
+			for (size_t i = 0; i < count; i++)
+			{
+				vf2d denorm = uvs[i] * scale;
+				out[i] = GetTap<wrap>((int)denorm.x, (int)denorm.y);
+			}
+		}
+		break;
+
+		case SampleMethod::BILINEAR:
+		{
+			for (size_t i = 0; i < count; i++)
+			{
+				vf2d denorm = uvs[i] * scale;
+				vf2d cell = denorm.floor();
+
+				int x = (int)cell.x;
+				int y = (int)cell.y;
+
+				out[i] = Pixel::Bilinear(
+					GetTap<wrap>(x, y), GetTap<wrap>(x + 1, y),
+					GetTap<wrap>(x, y + 1), GetTap<wrap>(x + 1, y + 1),
+					int((denorm.x - cell.x) * 256.0f), int((denorm.y - cell.y) * 256.0f));
+			}
+		}
+		break;
+
+		case SampleMethod::BICUBIC:
+		{
+			Pixel taps[16];
+
+			for (size_t i = 0; i < count; i++)
+			{
+				vf2d denorm = uvs[i] * scale - vf2d(0.5f, 0.5f);
+				vf2d cell = denorm.floor();
+
+				int x = (int)cell.x - 1;
+				int y = (int)cell.y - 1;
+
+				for (int ty = 0; ty < 4; ty++)
+					for (int tx = 0; tx < 4; tx++)
+						taps[ty * 4 + tx] = GetTap<wrap>(x + tx, y + ty);
+
+				const float* weightsX = GetCubicWeights(int((denorm.x - cell.x) * 256.0f + 0.5f));
+				const float* weightsY = GetCubicWeights(int((denorm.y - cell.y) * 256.0f + 0.5f));
+
+				out[i] = Pixel::Bicubic(taps, weightsX, weightsY);
+			}
+		}
+		break;
+
+		default: break;
+
+		}
+	}
+
+	const float* Sprite::GetCubicWeights(int offset)
+	{
+		static const auto weights = []()
+			{
+				std::vector<float> table(257 * 4);
+
+				for (int i = 0; i <= 256; i++)
+				{
+					float t = (float)i / 256.0f;
+					float tt = t * t;
+					float ttt = tt * t;
+
+					table[i * 4 + 0] = 0.5f * (-ttt + 2.0f * tt - t);
+					table[i * 4 + 1] = 0.5f * (3.0f * ttt - 5.0f * tt + 2.0f);
+					table[i * 4 + 2] = 0.5f * (-3.0f * ttt + 4.0f * tt + t);
+					table[i * 4 + 3] = 0.5f * (ttt - tt);
+				}
+
+				return table;
+			}();
+
+		return weights.data() + offset * 4;
+	}
+
+	const Sprite* Sprite::GetMipLevel(int level) const
+	{
+		// A sprite of one pixel has no other levels
+		if (level <= 0 || (size.x <= 1 && size.y <= 1))
+			return this;
+
+		BuildMipLevels();
+
+		return &m_MipLevels[std::min(level, (int)m_MipLevels.size()) - 1];
+	}
+
+	int Sprite::GetMipLevelsCount() const
+	{
+		int count = 1;
+
+		for (vi2d levelSize = size; levelSize.x > 1 || levelSize.y > 1; count++)
+			levelSize = levelSize.max({ 2, 2 }) / 2;
+
+		return count;
+	}
+
+	float Sprite::GetMipLod(const vf2d& uvDeltaX, const vf2d& uvDeltaY) const
+	{
+		vf2d scale = size;
+
+		// The longest of the two steps in texels, log2 of its square is halved instead of taking the root
+		float step = std::max((uvDeltaX * scale).mag2(), (uvDeltaY * scale).mag2());
+
+		return step > 1.0f ? 0.5f * std::log2(step) : 0.0f;
+	}
+
+	void Sprite::BuildMipLevels() const
+	{
+		// The shaders can sample the sprite from a few threads at once so only one of them builds the levels
+		std::atomic_ref<bool> valid(m_MipLevelsValid);
+
+		if (valid.load(std::memory_order_acquire))
+			return;
+
+		static std::mutex mutex;
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (valid.load(std::memory_order_relaxed))
+			return;
+
+		vi2d start = m_MipDirtyStart;
+		vi2d end = m_MipDirtyEnd;
+
+		// The sprite was resized so all of the levels are built again
+		if (m_MipLevels.empty() || (int)m_MipLevels.size() != GetMipLevelsCount() - 1 || m_MipLevels[0].size != size.max({ 2, 2 }) / 2)
+		{
+			m_MipLevels.resize(GetMipLevelsCount() - 1);
+
+			start = { 0, 0 };
+			end = size;
+		}
+
+		const Sprite* source = this;
+
+		for (Sprite& level : m_MipLevels)
+		{
+			vi2d levelSize = source->size.max({ 2, 2 }) / 2;
+
+			if (level.size != levelSize)
+			{
+				level.size = levelSize;
+				level.pixels.resize(level.size.x * level.size.y);
+			}
+
+			// Every pixel of the level is averaged from two rows and two columns of the source
+			start /= 2;
+			end = ((end + 1) / 2).min(level.size);
+
+			for (int y = start.y; y < end.y; y++)
+			{
+				// A side of one pixel is averaged with itself
+				const Pixel* top = source->pixels.data() + std::min(y * 2, source->size.y - 1) * source->size.x;
+				const Pixel* bottom = source->pixels.data() + std::min(y * 2 + 1, source->size.y - 1) * source->size.x;
+
+				Pixel* dest = level.pixels.data() + y * level.size.x;
+
+				if (source->size.x > 1)
+					Pixel::Downsample(top + start.x * 2, bottom + start.x * 2, dest + start.x, end.x - start.x);
+				else
+				{
+					Pixel column[4] = { top[0], top[0], bottom[0], bottom[0] };
+					Pixel::Downsample(column, column + 2, dest, 1);
+				}
+			}
+
+			source = &level;
+		}
+
+		valid.store(true, std::memory_order_release);
+	}
+
+	void Sprite::FlushRecorded() const
+	{
+		if (m_IsRecorded && GameEngine::s_Engine)
+			GameEngine::s_Engine->FlushDrawing();
+	}
+
+	void Sprite::MarkDirty(int x, int y, int width, int height)
+	{
+		int startX = std::max(x, 0);
+		int startY = std::max(y, 0);
+		int endX = std::min(x + width, size.x);
+		int endY = std::min(y + height, size.y);
+
+		if (startX < endX && startY < endY)
+			ExpandDirty(startX, startY, endX, endY);
+
+		m_Content = Content::UNKNOWN;
+	}
+
+	void Sprite::MarkDirty()
+	{
+		m_DirtyStart = { 0, 0 };
+		m_DirtyEnd = size;
+
+		m_Content = Content::UNKNOWN;
+
+		m_MipDirtyStart = { 0, 0 };
+		m_MipDirtyEnd = size;
+		m_MipLevelsValid = false;
+	}
+
+	bool Sprite::IsDirty() const
+	{
+		return m_DirtyStart.x < m_DirtyEnd.x && m_DirtyStart.y < m_DirtyEnd.y;
+	}
+
+	void Sprite::ClearDirty()
+	{
+		m_DirtyStart = size;
+		m_DirtyEnd = { 0, 0 };
+	}
+
+	const vi2d& Sprite::GetDirtyStart() const
+	{
+		return m_DirtyStart;
+	}
+
+	const vi2d& Sprite::GetDirtyEnd() const
+	{
+		return m_DirtyEnd;
+	}
+
+	Sprite::Content Sprite::GetContent() const
+	{
+		return m_Content;
+	}
+
+	Sprite::Content Sprite::GetContent(const Pixel& col)
+	{
+		switch (col.a)
+		{
+		case 0: return Content::TRANSPARENT;
+		case 255: return Content::OPAQUE;
+		}
+
+		return Content::UNKNOWN;
+	}
+
+	void Sprite::ExpandDirty(int startX, int startY, int endX, int endY)
+	{
+		if (m_MipLevelsValid)
+		{
+			m_MipDirtyStart = { startX, startY };
+			m_MipDirtyEnd = { endX, endY };
+			m_MipLevelsValid = false;
+		}
+		else
+		{
+			m_MipDirtyStart = m_MipDirtyStart.min({ startX, startY });
+			m_MipDirtyEnd = m_MipDirtyEnd.max({ endX, endY });
 		}
 
+		if (!IsDirty())
+		{
+			m_DirtyStart = { startX, startY };
+			m_DirtyEnd = { endX, endY };
+			return;
 		}
 
-		return NONE;
+		m_DirtyStart.x = std::min(m_DirtyStart.x, startX);
+		m_DirtyStart.y = std::min(m_DirtyStart.y, startY);
+		m_DirtyEnd.x = std::max(m_DirtyEnd.x, endX);
+		m_DirtyEnd.y = std::max(m_DirtyEnd.y, endY);
 	}
 
-	Texture::Texture(Sprite* sprite)
+	Texture::Texture(Sprite* sprite, bool mipmaps) : mipmaps(mipmaps)
 	{
 		Construct(sprite, false);
 	}
 
-	Texture::Texture(std::string_view fileName)
+	Texture::Texture(std::string_view fileName, bool mipmaps) : mipmaps(mipmaps)
 	{
 		Construct(new Sprite(fileName), true);
 	}
@@ -1885,7 +4289,7 @@ namespace def
 		glBindTexture(GL_TEXTURE_2D, id);
 
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, CanMipmap(sprite) ? GL_LINEAR_MIPMAP_LINEAR : GL_NEAREST);
 
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -1901,41 +4305,135 @@ namespace def
 			sprite->pixels.data()
 		);
 
+		if (CanMipmap(sprite))
+			UploadMipLevels(sprite);
+
 		glBindTexture(GL_TEXTURE_2D, 0);
+#elif defined(PLATFORM_HEADLESS)
+		id = Platform_Headless::CreateTexture(sprite);
 #else
 #error Consider defining PLATFORM_GL macro
 #endif
+
+		sprite->ClearDirty();
 	}
 
 	void Texture::Update(Sprite* sprite)
 	{
+		if (!sprite->IsDirty())
+			return;
+
+		// The sprite was resized so the whole texture is reallocated
+		if (sprite->size != size)
+		{
 #if defined(PLATFORM_GL) || defined(PLATFORM_EMSCRIPTEN)
-		glBindTexture(GL_TEXTURE_2D, id);
+			glDeleteTextures(1, &id);
+#endif
+			Load(sprite);
 
-		glTexImage2D(
-			GL_TEXTURE_2D,
-			0, GL_RGBA,
-			sprite->size.x,
-			sprite->size.y,
-			0, GL_RGBA,
-			GL_UNSIGNED_BYTE,
-			sprite->pixels.data()
+			uvScale = 1.0f / vf2d(sprite->size);
+			size = sprite->size;
+
+			return;
+		}
+
+#if defined(PLATFORM_GL) || defined(PLATFORM_EMSCRIPTEN)
+		const vi2d& start = sprite->GetDirtyStart();
+		const vi2d& end = sprite->GetDirtyEnd();
+
+		glBindTexture(GL_TEXTURE_2D, id);
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, sprite->size.x);
+
+		glTexSubImage2D(
+			GL_TEXTURE_2D, 0,
+			start.x, start.y,
+			end.x - start.x,
+			end.y - start.y,
+			GL_RGBA, GL_UNSIGNED_BYTE,
+			sprite->pixels.data() + start.y * sprite->size.x + start.x
 		);
 
+		if (CanMipmap(sprite))
+			UpdateMipLevels(sprite, start, end);
+
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
 		glBindTexture(GL_TEXTURE_2D, 0);
+#elif defined(PLATFORM_HEADLESS)
+		Platform_Headless::UpdateTexture(id, sprite);
 #else
 #error Consider defining PLATFORM_GL macro
 #endif
+
+		sprite->ClearDirty();
 	}
 
-	Graphic::Graphic(std::string_view fileName)
+	bool Texture::CanMipmap(const Sprite* sprite) const
 	{
-		Load(fileName);
+#if defined(PLATFORM_HEADLESS)
+		// The CPU rasterizer samples only the level 0
+		return false;
+#else
+		return mipmaps;
+#endif
+	}
+
+	void Texture::UploadMipLevels(const Sprite* sprite)
+	{
+#if defined(PLATFORM_GL) || defined(PLATFORM_EMSCRIPTEN)
+		for (int i = 1; i < sprite->GetMipLevelsCount(); i++)
+		{
+			const Sprite* level = sprite->GetMipLevel(i);
+
+			glTexImage2D(
+				GL_TEXTURE_2D,
+				i, GL_RGBA,
+				level->size.x,
+				level->size.y,
+				0, GL_RGBA,
+				GL_UNSIGNED_BYTE,
+				level->pixels.data()
+			);
+		}
+#endif
+	}
+
+	void Texture::UpdateMipLevels(const Sprite* sprite, vi2d start, vi2d end)
+	{
+#if defined(PLATFORM_GL) || defined(PLATFORM_EMSCRIPTEN)
+		for (int i = 1; i < sprite->GetMipLevelsCount(); i++)
+		{
+			const Sprite* level = sprite->GetMipLevel(i);
+
+			// The changed region is halved the same way as the levels are built
+			start /= 2;
+			end = ((end + 1) / 2).min(level->size);
+
+			if (start.x >= end.x || start.y >= end.y)
+				break;
+
+			glPixelStorei(GL_UNPACK_ROW_LENGTH, level->size.x);
+
+			glTexSubImage2D(
+				GL_TEXTURE_2D, i,
+				start.x, start.y,
+				end.x - start.x,
+				end.y - start.y,
+				GL_RGBA, GL_UNSIGNED_BYTE,
+				level->pixels.data() + start.y * level->size.x + start.x
+			);
+		}
+#endif
+	}
+
+	Graphic::Graphic(std::string_view fileName, bool mipmaps)
+	{
+		Load(fileName, mipmaps);
 	}
 
-	Graphic::Graphic(const vi2d& size)
+	Graphic::Graphic(const vi2d& size, bool mipmaps)
 	{
-		Load(size);
+		Load(size, mipmaps);
 	}
 
 	Graphic::~Graphic()
@@ -1944,16 +4442,16 @@ namespace def
 		delete sprite;
 	}
 
-	void Graphic::Load(std::string_view fileName)
+	void Graphic::Load(std::string_view fileName, bool mipmaps)
 	{
 		sprite = new Sprite(fileName);
-		texture = new Texture(sprite);
+		texture = new Texture(sprite, mipmaps);
 	}
 
-	void Graphic::Load(const vi2d& size)
+	void Graphic::Load(const vi2d& size, bool mipmaps)
 	{
 		sprite = new Sprite(size);
-		texture = new Texture(sprite);
+		texture = new Texture(sprite, mipmaps);
 	}
 
 	void Graphic::Save(std::string_view fileName, const Sprite::FileType type) const
@@ -1966,14 +4464,35 @@ namespace def
 		texture->Update(sprite);
 	}
 
+	bool Layer::IsEmpty() const
+	{
+		return tint.a == 0 || (update && pixels->sprite->GetContent() == Sprite::Content::TRANSPARENT);
+	}
+
+	bool Layer::IsOpaque() const
+	{
+		return visible && update && pixels && tint.a == 255 && pixels->sprite->GetContent() == Sprite::Content::OPAQUE;
+	}
+
 	TextureInstance::TextureInstance()
 	{
 		texture = nullptr;
 
 		structure = Texture::Structure::FAN;
 		points = 0;
+		offset = 0;
+	}
+
+	void TextCache::Clear()
+	{
+		m_Text.clear();
+		m_Vertices.clear();
+	}
 
-		uv = { { 0.0f, 0.0f }, { 0.0f, 1.0f }, { 1.0f, 1.0f }, { 1.0f, 0.0f } };
+	void Platform::DrawTextures(const std::vector<TextureInstance>& textures, const std::vector<TextureVertex>& vertices) const
+	{
+		for (const auto& texInst : textures)
+			DrawTexture(texInst, vertices.data() + texInst.offset);
 	}
 
 #ifdef PLATFORM_GL
@@ -2005,26 +4524,118 @@ namespace def
 		glEnd();
 	}
 
-	void Platform_GL::DrawTexture(const TextureInstance& texInst) const
+	void Platform_GL::DrawTexture(const TextureInstance& texInst, const TextureVertex* vertices) const
+	{
+		BindTexture(texInst.texture ? texInst.texture->id : 0);
+
+		switch (texInst.structure)
+		{
+		case Texture::Structure::DEFAULT:	glBegin(GL_TRIANGLES);		break;
+		case Texture::Structure::FAN:		glBegin(GL_TRIANGLE_FAN);	break;
+		case Texture::Structure::STRIP:		glBegin(GL_TRIANGLE_STRIP);	break;
+		case Texture::Structure::WIREFRAME:	glBegin(GL_LINE_LOOP);		break;
+		}
+
+		for (uint32_t i = 0; i < texInst.points; i++)
+		{
+			const TextureVertex& v = vertices[i];
+
+			glColor4ub(v.tint.r, v.tint.g, v.tint.b, v.tint.a);
+			glTexCoord2f(v.uv.x, v.uv.y);
+			glVertex2f(v.pos.x, v.pos.y);
+		}
+
+		glEnd();
+	}
+
+	void Platform_GL::DrawTextures(const std::vector<TextureInstance>& textures, const std::vector<TextureVertex>& vertices) const
 	{
-		BindTexture(texInst.texture ? texInst.texture->id : 0);
+		m_BatchVertices.clear();
+		m_Batches.clear();
 
-		switch (texInst.structure)
+		// Convert every instance into a triangle or a line list and merge
+		// consecutive instances that can be drawn with a single call
+		for (const auto& texInst : textures)
 		{
-		case Texture::Structure::DEFAULT:	glBegin(GL_TRIANGLES);		break;
-		case Texture::Structure::FAN:		glBegin(GL_TRIANGLE_FAN);	break;
-		case Texture::Structure::STRIP:		glBegin(GL_TRIANGLE_STRIP);	break;
-		case Texture::Structure::WIREFRAME:	glBegin(GL_LINE_LOOP);		break;
+			const TextureVertex* v = vertices.data() + texInst.offset;
+			int texture = texInst.texture ? texInst.texture->id : 0;
+			GLenum mode = texInst.structure == Texture::Structure::WIREFRAME ? GL_LINES : GL_TRIANGLES;
+
+			if (m_Batches.empty() || m_Batches.back().texture != texture || m_Batches.back().mode != mode)
+				m_Batches.push_back({ texture, mode, (GLint)m_BatchVertices.size(), 0 });
+
+			switch (texInst.structure)
+			{
+			case Texture::Structure::DEFAULT:
+				m_BatchVertices.insert(m_BatchVertices.end(), v, v + texInst.points / 3 * 3);
+				break;
+
+			case Texture::Structure::FAN:
+			{
+				for (uint32_t i = 1; i + 1 < texInst.points; i++)
+				{
+					m_BatchVertices.push_back(v[0]);
+					m_BatchVertices.push_back(v[i]);
+					m_BatchVertices.push_back(v[i + 1]);
+				}
+			}
+			break;
+
+			case Texture::Structure::STRIP:
+			{
+				// Swap every odd triangle to keep the winding of the strip
+				for (uint32_t i = 0; i + 2 < texInst.points; i++)
+				{
+					m_BatchVertices.push_back(v[i + (i & 1)]);
+					m_BatchVertices.push_back(v[i + 1 - (i & 1)]);
+					m_BatchVertices.push_back(v[i + 2]);
+				}
+			}
+			break;
+
+			case Texture::Structure::WIREFRAME:
+			{
+				// A closed loop of two points is a single segment
+				uint32_t segments = texInst.points == 2 ? 1 : texInst.points;
+
+				for (uint32_t i = 0; i < segments && texInst.points > 1; i++)
+				{
+					m_BatchVertices.push_back(v[i]);
+					m_BatchVertices.push_back(v[(i + 1) % texInst.points]);
+				}
+			}
+			break;
+
+			}
+
+			m_Batches.back().count = (GLsizei)m_BatchVertices.size() - m_Batches.back().first;
 		}
 
-		for (uint32_t i = 0; i < texInst.points; i++)
+		if (m_BatchVertices.empty())
+			return;
+
+		const TextureVertex* data = m_BatchVertices.data();
+
+		glEnableClientState(GL_VERTEX_ARRAY);
+		glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+		glEnableClientState(GL_COLOR_ARRAY);
+
+		glVertexPointer(2, GL_FLOAT, sizeof(TextureVertex), &data->pos);
+		glTexCoordPointer(2, GL_FLOAT, sizeof(TextureVertex), &data->uv);
+		glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(TextureVertex), &data->tint);
+
+		for (const auto& batch : m_Batches)
 		{
-			glColor4ub(texInst.tint[i].r, texInst.tint[i].g, texInst.tint[i].b, texInst.tint[i].a);
-			glTexCoord2f(texInst.uv[i].x, texInst.uv[i].y);
-			glVertex2f(texInst.vertices[i].x, texInst.vertices[i].y);
+			if (batch.count > 0)
+			{
+				BindTexture(batch.texture);
+				glDrawArrays(batch.mode, batch.first, batch.count);
+			}
 		}
 
-		glEnd();
+		glDisableClientState(GL_COLOR_ARRAY);
+		glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+		glDisableClientState(GL_VERTEX_ARRAY);
 	}
 
 	void Platform_GL::BindTexture(int id) const
@@ -2250,14 +4861,8 @@ namespace def
 		glUseProgram(m_QuadShader);
 		glBindVertexArrayOES(m_VaQuad);
 
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), 0);
-		glEnableVertexAttribArray(0);
-
-		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(3 * sizeof(float)));
-		glEnableVertexAttribArray(1);
-
-		glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), (void*)(5 * sizeof(float)));
-		glEnableVertexAttribArray(2);
+		glBindBuffer(GL_ARRAY_BUFFER, m_VbQuad);
+		SetVertexLayout();
 	}
 
 	void Platform_Emscripten::OnAfterDraw()
@@ -2292,32 +4897,144 @@ namespace def
 		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 	}
 
-	void Platform_Emscripten::DrawTexture(const TextureInstance& texInst) const
+	void Platform_Emscripten::DrawTexture(const TextureInstance& texInst, const TextureVertex* vertices) const
 	{
-		BindTexture(texInst.texture ? texInst.texture->id : 0);
+		TextureInstance instance = texInst;
+		instance.offset = 0;
 
-		glBindBuffer(GL_ARRAY_BUFFER, m_VbQuad);
+		StreamTextures(&instance, 1, vertices, texInst.points);
+	}
 
-		for (uint32_t i = 0; i < texInst.points; i++)
+	void Platform_Emscripten::DrawTextures(const std::vector<TextureInstance>& textures, const std::vector<TextureVertex>& vertices) const
+	{
+		StreamTextures(textures.data(), textures.size(), vertices.data(), vertices.size());
+	}
+
+	void Platform_Emscripten::SetVertexLayout() const
+	{
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), 0);
+		glEnableVertexAttribArray(0);
+
+		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(3 * sizeof(float)));
+		glEnableVertexAttribArray(1);
+
+		glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), (void*)(5 * sizeof(float)));
+		glEnableVertexAttribArray(2);
+	}
+
+	void Platform_Emscripten::StreamTextures(const TextureInstance* textures, size_t count, const TextureVertex* vertices, size_t verticesCount) const
+	{
+		m_StreamIndices.clear();
+		m_Batches.clear();
+
+		// Convert every instance into indices of a triangle or a line list and merge
+		// consecutive instances that can be drawn with a single call
+		for (size_t i = 0; i < count; i++)
+		{
+			const TextureInstance& texInst = textures[i];
+
+			uint32_t base = texInst.offset;
+			int texture = texInst.texture ? texInst.texture->id : 0;
+			GLenum mode = texInst.structure == Texture::Structure::WIREFRAME ? GL_LINES : GL_TRIANGLES;
+
+			if (m_Batches.empty() || m_Batches.back().texture != texture || m_Batches.back().mode != mode)
+				m_Batches.push_back({ texture, mode, (uint32_t)m_StreamIndices.size(), 0 });
+
+			switch (texInst.structure)
+			{
+			case Texture::Structure::DEFAULT:
+			{
+				for (uint32_t j = 0; j < texInst.points / 3 * 3; j++)
+					m_StreamIndices.push_back(base + j);
+			}
+			break;
+
+			case Texture::Structure::FAN:
+			{
+				for (uint32_t j = 1; j + 1 < texInst.points; j++)
+				{
+					m_StreamIndices.push_back(base);
+					m_StreamIndices.push_back(base + j);
+					m_StreamIndices.push_back(base + j + 1);
+				}
+			}
+			break;
+
+			case Texture::Structure::STRIP:
+			{
+				// Swap every odd triangle to keep the winding of the strip
+				for (uint32_t j = 0; j + 2 < texInst.points; j++)
+				{
+					m_StreamIndices.push_back(base + j + (j & 1));
+					m_StreamIndices.push_back(base + j + 1 - (j & 1));
+					m_StreamIndices.push_back(base + j + 2);
+				}
+			}
+			break;
+
+			case Texture::Structure::WIREFRAME:
+			{
+				// A closed loop of two points is a single segment
+				uint32_t segments = texInst.points == 2 ? 1 : texInst.points;
+
+				for (uint32_t j = 0; j < segments && texInst.points > 1; j++)
+				{
+					m_StreamIndices.push_back(base + j);
+					m_StreamIndices.push_back(base + (j + 1) % texInst.points);
+				}
+			}
+			break;
+
+			}
+
+			m_Batches.back().count = (uint32_t)m_StreamIndices.size() - m_Batches.back().first;
+		}
+
+		if (m_StreamIndices.empty())
+			return;
+
+		m_StreamVertices.resize(verticesCount);
+
+		for (size_t i = 0; i < verticesCount; i++)
 		{
-			m_VertexMemory[i].pos[0] = texInst.vertices[i].x;
-			m_VertexMemory[i].pos[1] = texInst.vertices[i].y;
-			m_VertexMemory[i].pos[2] = 1.0f;
+			Vertex& v = m_StreamVertices[i];
 
-			m_VertexMemory[i].uv.x = texInst.uv[i].x;
-			m_VertexMemory[i].uv.y = texInst.uv[i].y;
-			m_VertexMemory[i].col = texInst.tint[i];
+			v.pos[0] = vertices[i].pos.x;
+			v.pos[1] = vertices[i].pos.y;
+			v.pos[2] = 1.0f;
+
+			v.uv = vertices[i].uv;
+			v.col = vertices[i].tint;
 		}
 
-		glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * texInst.points, m_VertexMemory, GL_STREAM_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, m_VbStream);
+		UploadStream(GL_ARRAY_BUFFER, m_VbStreamCapacity, m_StreamVertices.data(), m_StreamVertices.size() * sizeof(Vertex));
+		SetVertexLayout();
 
-		switch (texInst.structure)
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_IbStream);
+		UploadStream(GL_ELEMENT_ARRAY_BUFFER, m_IbStreamCapacity, m_StreamIndices.data(), m_StreamIndices.size() * sizeof(uint32_t));
+
+		for (const auto& batch : m_Batches)
 		{
-		case Texture::Structure::WIREFRAME: glDrawArrays(GL_LINE_LOOP, 0, texInst.points); break;
-		case Texture::Structure::FAN: glDrawArrays(GL_TRIANGLE_FAN, 0, texInst.points); break;
-		case Texture::Structure::STRIP: glDrawArrays(GL_TRIANGLE_STRIP, 0, texInst.points); break;
-		case Texture::Structure::DEFAULT: glDrawArrays(GL_TRIANGLES, 0, texInst.points); break;
+			if (batch.count > 0)
+			{
+				BindTexture(batch.texture);
+				glDrawElements(batch.mode, batch.count, GL_UNSIGNED_INT, (void*)(batch.first * sizeof(uint32_t)));
+			}
 		}
+
+		// DrawQuad expects the attributes to point into the quad buffer
+		glBindBuffer(GL_ARRAY_BUFFER, m_VbQuad);
+		SetVertexLayout();
+	}
+
+	void Platform_Emscripten::UploadStream(GLenum target, size_t& capacity, const void* data, size_t size)
+	{
+		if (size > capacity)
+			capacity = std::max(size, capacity * 2);
+
+		glBufferData(target, capacity, nullptr, GL_STREAM_DRAW);
+		glBufferSubData(target, 0, size, data);
 	}
 
 	void Platform_Emscripten::BindTexture(int id) const
@@ -2378,28 +5095,24 @@ namespace def
 		glLinkProgram(m_QuadShader);
 
 		glGenBuffers(1, &m_VbQuad);
+		glGenBuffers(1, &m_VbStream);
+		glGenBuffers(1, &m_IbStream);
 		glGenVertexArraysOES(1, &m_VaQuad);
 
 		glBindVertexArrayOES(m_VaQuad);
 		glBindBuffer(GL_ARRAY_BUFFER, m_VbQuad);
 
-		Vertex vertices[128];
-		glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * 128, vertices, GL_STREAM_DRAW);
-
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), 0);
-		glEnableVertexAttribArray(0);
-
-		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(3 * sizeof(float)));
-		glEnableVertexAttribArray(1);
+		Vertex vertices[4];
+		glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * 4, vertices, GL_STREAM_DRAW);
 
-		glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), (void*)(5 * sizeof(float)));
-		glEnableVertexAttribArray(2);
+		SetVertexLayout();
 
 		glBindBuffer(GL_ARRAY_BUFFER, 0);
 		glBindVertexArrayOES(0);
 
 		m_BlankQuad.Load({ 1, 1 });
 		m_BlankQuad.sprite->pixels[0] = WHITE;
+		m_BlankQuad.sprite->MarkDirty();
 		m_BlankQuad.UpdateTexture();
 
 		emscripten_set_keydown_callback("#canvas", 0, 1, KeyboardCallback);
@@ -2491,41 +5204,282 @@ namespace def
 
 		}
 
-		return EM_TRUE;
+		return EM_TRUE;
+	}
+
+	EM_BOOL Platform_Emscripten::MouseCallback(int eventType, const EmscriptenMouseEvent* event, void* userData)
+	{
+		GameEngine* e = GameEngine::s_Engine;
+
+		if (eventType == EMSCRIPTEN_EVENT_MOUSEMOVE)
+		{
+			e->m_MousePos.x = event->targetX / e->m_PixelSize.x;
+			e->m_MousePos.y = event->targetY / e->m_PixelSize.y;
+		}
+
+		auto check = [&](int button, int index)
+			{
+				if (event->button == button)
+				{
+					switch (eventType)
+					{
+					case EMSCRIPTEN_EVENT_MOUSEDOWN: e->m_MouseNewState[index] = true; break;
+					case EMSCRIPTEN_EVENT_MOUSEUP: e->m_MouseNewState[index] = false; break;
+					}
+
+					return true;
+				}
+
+				return false;
+			};
+
+		check(0, 0);
+		check(2, 1);
+		check(3, 3);
+		check(4, 4);
+
+		return check(1, 2) ? EM_TRUE : EM_FALSE;
+	}
+
+#endif
+
+#ifdef PLATFORM_HEADLESS
+
+	void Platform_Headless::Destroy() const {}
+	void Platform_Headless::SetTitle(const std::string& text) const {}
+
+	bool Platform_Headless::IsWindowClose() const { return false; }
+	bool Platform_Headless::IsWindowFocused() const { return true; }
+
+	void Platform_Headless::ClearBuffer(const Pixel& col) const
+	{
+		m_Framebuffer.SetPixelData(col);
+	}
+
+	void Platform_Headless::OnBeforeDraw() {}
+	void Platform_Headless::OnAfterDraw() {}
+
+	void Platform_Headless::FlushScreen(bool vsync) const {}
+	void Platform_Headless::PollEvents() const {}
+
+	void Platform_Headless::DrawQuad(const Pixel& tint) const
+	{
+		const Sprite* tex = GetTexture(m_BoundTexture);
+		const vi2d& size = m_Framebuffer.size;
+
+		for (int y = 0; y < size.y; y++)
+			for (int x = 0; x < size.x; x++)
+			{
+				Pixel texel = WHITE;
+
+				if (tex)
+				{
+					// The quad maps (0, 0) of the texture to the top left corner of the screen
+					int tx = x * tex->size.x / size.x;
+					int ty = y * tex->size.y / size.y;
+
+					texel = tex->pixels[ty * tex->size.x + tx];
+				}
+
+				Blend(x, y, Modulate(texel, tint));
+			}
+	}
+
+	void Platform_Headless::DrawTexture(const TextureInstance& texInst, const TextureVertex* vertices) const
+	{
+		BindTexture(texInst.texture ? texInst.texture->id : 0);
+
+		switch (texInst.structure)
+		{
+		case Texture::Structure::DEFAULT:
+		{
+			for (uint32_t i = 0; i + 2 < texInst.points; i += 3)
+				RasterTriangle(vertices[i], vertices[i + 1], vertices[i + 2]);
+		}
+		break;
+
+		case Texture::Structure::FAN:
+		{
+			for (uint32_t i = 1; i + 1 < texInst.points; i++)
+				RasterTriangle(vertices[0], vertices[i], vertices[i + 1]);
+		}
+		break;
+
+		case Texture::Structure::STRIP:
+		{
+			for (uint32_t i = 0; i + 2 < texInst.points; i++)
+				RasterTriangle(vertices[i], vertices[i + 1], vertices[i + 2]);
+		}
+		break;
+
+		case Texture::Structure::WIREFRAME:
+		{
+			for (uint32_t i = 0; i < texInst.points; i++)
+				RasterLine(vertices[i], vertices[(i + 1) % texInst.points]);
+		}
+		break;
+
+		}
+	}
+
+	void Platform_Headless::BindTexture(int id) const
+	{
+		m_BoundTexture = id;
+	}
+
+	bool Platform_Headless::ConstructWindow(vi2d& screenSize, const vi2d pixelSize, vi2d& windowSize, bool vsync, bool fullscreen, bool dirtypixel)
+	{
+		m_Framebuffer.Create(screenSize);
+		return true;
+	}
+
+	void Platform_Headless::SetIcon(Sprite& icon) const {}
+
+	const Sprite& Platform_Headless::GetFramebuffer() const
+	{
+		return m_Framebuffer;
+	}
+
+	uint32_t Platform_Headless::CreateTexture(const Sprite* sprite)
+	{
+		s_Textures.push_back(*sprite);
+		return (uint32_t)s_Textures.size();
+	}
+
+	void Platform_Headless::UpdateTexture(uint32_t id, const Sprite* sprite)
+	{
+		if (id == 0 || id > s_Textures.size())
+			return;
+
+		Sprite& texture = s_Textures[id - 1];
+
+		if (texture.size != sprite->size)
+		{
+			texture = *sprite;
+			return;
+		}
+
+		const vi2d& start = sprite->GetDirtyStart();
+		const vi2d& end = sprite->GetDirtyEnd();
+
+		for (int y = start.y; y < end.y; y++)
+		{
+			auto row = sprite->pixels.begin() + y * sprite->size.x;
+			std::copy(row + start.x, row + end.x, texture.pixels.begin() + y * texture.size.x + start.x);
+		}
+	}
+
+	const Sprite* Platform_Headless::GetTexture(int id) const
+	{
+		if (id > 0 && id <= (int)s_Textures.size())
+			return &s_Textures[id - 1];
+
+		return nullptr;
+	}
+
+	vf2d Platform_Headless::ToScreen(const vf2d& ndc) const
+	{
+		return { (ndc.x + 1.0f) * 0.5f * (float)m_Framebuffer.size.x, (1.0f - ndc.y) * 0.5f * (float)m_Framebuffer.size.y };
+	}
+
+	void Platform_Headless::Blend(int x, int y, const Pixel& col) const
+	{
+		// Matches glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA) for all 4 channels
+		Pixel& d = m_Framebuffer.pixels[y * m_Framebuffer.size.x + x];
+		uint32_t a = col.a;
+
+		for (int i = 0; i < 4; i++)
+			d.rgba_v[i] = uint8_t((col.rgba_v[i] * a + d.rgba_v[i] * (255 - a) + 127) / 255);
+	}
+
+	void Platform_Headless::RasterTriangle(const TextureVertex& v0, const TextureVertex& v1, const TextureVertex& v2) const
+	{
+		const Sprite* tex = GetTexture(m_BoundTexture);
+
+		vf2d p0 = ToScreen(v0.pos);
+		vf2d p1 = ToScreen(v1.pos);
+		vf2d p2 = ToScreen(v2.pos);
+
+		float area = (p1 - p0).cross(p2 - p0);
+
+		if (area == 0.0f)
+			return;
+
+		float invArea = 1.0f / area;
+
+		vi2d min = vf2d(p0.min(p1).min(p2).floor()).max(vf2d(0.0f, 0.0f));
+		vi2d max = vf2d(p0.max(p1).max(p2).ceil()).min(vf2d(m_Framebuffer.size));
+
+		for (int y = min.y; y < max.y; y++)
+			for (int x = min.x; x < max.x; x++)
+			{
+				vf2d p((float)x + 0.5f, (float)y + 0.5f);
+
+				// Barycentric weights, positive inside for both windings
+				float w0 = (p2 - p1).cross(p - p1) * invArea;
+				float w1 = (p0 - p2).cross(p - p2) * invArea;
+				float w2 = 1.0f - w0 - w1;
+
+				if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+					continue;
+
+				vf2d uv = v0.uv * w0 + v1.uv * w1 + v2.uv * w2;
+
+				Pixel tint;
+				for (int i = 0; i < 4; i++)
+				{
+					float c = v0.tint.rgba_v[i] * w0 + v1.tint.rgba_v[i] * w1 + v2.tint.rgba_v[i] * w2;
+					tint.rgba_v[i] = (uint8_t)std::clamp(c + 0.5f, 0.0f, 255.0f);
+				}
+
+				Blend(x, y, Modulate(tex ? Fetch(tex, uv) : WHITE, tint));
+			}
 	}
 
-	EM_BOOL Platform_Emscripten::MouseCallback(int eventType, const EmscriptenMouseEvent* event, void* userData)
+	void Platform_Headless::RasterLine(const TextureVertex& v0, const TextureVertex& v1) const
 	{
-		GameEngine* e = GameEngine::s_Engine;
+		const Sprite* tex = GetTexture(m_BoundTexture);
 
-		if (eventType == EMSCRIPTEN_EVENT_MOUSEMOVE)
+		vf2d p0 = ToScreen(v0.pos);
+		vf2d p1 = ToScreen(v1.pos);
+
+		int steps = (int)std::max(std::abs(p1.x - p0.x), std::abs(p1.y - p0.y));
+
+		for (int s = 0; s <= steps; s++)
 		{
-			e->m_MousePos.x = event->targetX / e->m_PixelSize.x;
-			e->m_MousePos.y = event->targetY / e->m_PixelSize.y;
-		}
+			float t = steps > 0 ? (float)s / (float)steps : 0.0f;
+			vi2d p = p0.lerp(p1, t).floor();
 
-		auto check = [&](int button, int index)
-			{
-				if (event->button == button)
-				{
-					switch (eventType)
-					{
-					case EMSCRIPTEN_EVENT_MOUSEDOWN: e->m_MouseNewState[index] = true; break;
-					case EMSCRIPTEN_EVENT_MOUSEUP: e->m_MouseNewState[index] = false; break;
-					}
+			if (p.x < 0 || p.y < 0 || p.x >= m_Framebuffer.size.x || p.y >= m_Framebuffer.size.y)
+				continue;
 
-					return true;
-				}
+			vf2d uv = v0.uv.lerp(v1.uv, t);
+			Pixel tint = v0.tint.lerp(v1.tint, t);
 
-				return false;
-			};
+			Blend(p.x, p.y, Modulate(tex ? Fetch(tex, uv) : WHITE, tint));
+		}
+	}
 
-		check(0, 0);
-		check(2, 1);
-		check(3, 3);
-		check(4, 4);
+	Pixel Platform_Headless::Fetch(const Sprite* tex, const vf2d& uv)
+	{
+		// Nearest filtering with GL_REPEAT wrapping
+		int x = (int)std::floor(uv.x * (float)tex->size.x) % tex->size.x;
+		int y = (int)std::floor(uv.y * (float)tex->size.y) % tex->size.y;
 
-		return check(1, 2) ? EM_TRUE : EM_FALSE;
+		if (x < 0) x += tex->size.x;
+		if (y < 0) y += tex->size.y;
+
+		return tex->pixels[y * tex->size.x + x];
+	}
+
+	Pixel Platform_Headless::Modulate(const Pixel& texel, const Pixel& tint)
+	{
+		return Pixel(
+			uint8_t(texel.r * tint.r / 255),
+			uint8_t(texel.g * tint.g / 255),
+			uint8_t(texel.b * tint.b / 255),
+			uint8_t(texel.a * tint.a / 255)
+		);
 	}
 
 #endif
@@ -2545,6 +5499,19 @@ namespace def
 		m_DeltaTime = 0.0f;
 		m_TickTimer = 0.0f;
 
+		m_FixedDeltaTime = 0.0f;
+		m_FramesToRun = 0;
+		m_FrameIndex = 0;
+
+		m_NextDrawBand = 0;
+		m_ParallelDrawing = false;
+
+#ifndef PLATFORM_EMSCRIPTEN
+		m_DrawGeneration = 0;
+		m_DrawWorkersDone = 0;
+		m_StopDrawWorkers = false;
+#endif
+
 		s_Engine = this;
 
 		m_PickedConsoleHistoryCommand = 0;
@@ -2559,6 +5526,8 @@ namespace def
 		m_Platform = new Platform_GLFW3();
 #elif defined(PLATFORM_EMSCRIPTEN)
 		m_Platform = new Platform_Emscripten();
+#elif defined(PLATFORM_HEADLESS)
+		m_Platform = new Platform_Headless();
 #else
 #error No platform was selected
 #endif
@@ -2571,6 +5540,10 @@ namespace def
 
 	void GameEngine::Destroy()
 	{
+		// The layers would flush the drawing while they are deleted
+		FlushDrawing();
+		StopDrawWorkers();
+
 		for (auto& layer : m_Layers)
 		{
 			if (layer.pixels)
@@ -2610,9 +5583,15 @@ namespace def
 	{
 		if (m_IsAppRunning)
 		{
+			auto frameStart = std::chrono::steady_clock::now();
+
 			m_TimeEnd = std::chrono::system_clock::now();
 
-			m_DeltaTime = std::chrono::duration<float>(m_TimeEnd - m_TimeStart).count();
+			if (m_FixedDeltaTime > 0.0f)
+				m_DeltaTime = m_FixedDeltaTime;
+			else
+				m_DeltaTime = std::chrono::duration<float>(m_TimeEnd - m_TimeStart).count();
+
 			m_TimeStart = m_TimeEnd;
 
 			m_TickTimer += m_DeltaTime;
@@ -2620,6 +5599,12 @@ namespace def
 			if (m_Platform->IsWindowClose())
 				m_IsAppRunning = false;
 
+			if (m_InputReplay.is_open())
+				ReplayInputFrame();
+
+			if (m_InputRecord.is_open())
+				RecordInputFrame();
+
 			ScanHardware(m_Keys, m_KeyNewState, m_KeyOldState, (size_t)Key::KEYS_COUNT);
 			ScanHardware(m_Mouse, m_MouseNewState, m_MouseOldState, 8);
 
@@ -2738,47 +5723,64 @@ namespace def
 				int printCount = std::min(ScreenHeight() / 22, (int)m_ConsoleHistory.size());
 				int start = m_ConsoleHistory.size() - printCount;
 
+				// Two lines for every entry and one for the input
+				m_ConsoleCaches.resize(printCount * 2 + 1);
+
 				for (size_t i = start; i < m_ConsoleHistory.size(); i++)
 				{
 					auto& entry = m_ConsoleHistory[i];
+					size_t line = (i - start) * 2;
 
-					DrawTextureString({ 10, 10 + int(i - start) * 20 }, "> " + entry.command);
-					DrawTextureString({ 10, 20 + int(i - start) * 20 }, entry.output, entry.outputColour);
+					DrawTextureString(m_ConsoleCaches[line], { 10, 10 + int(i - start) * 20 }, "> " + entry.command);
+					DrawTextureString(m_ConsoleCaches[line + 1], { 10, 20 + int(i - start) * 20 }, entry.output, entry.outputColour);
 				}
 
 				int x = GetCursorPos() * 8 + 36;
 				int y = ScreenHeight() - 18;
 
-				DrawTextureString({ 20, y }, "> " + GetCapturedText(), YELLOW);
+				DrawTextureString(m_ConsoleCaches.back(), { 20, y }, "> " + GetCapturedText(), YELLOW);
 				DrawTextureLine({ x, y }, { x, y + 8 }, RED);
 
 				PickLayer(currentLayer);
 			}
 
+			FlushDrawing();
+
+			auto updateEnd = std::chrono::steady_clock::now();
+
 			m_Platform->ClearBuffer(m_BackgroundColour);
 			m_Platform->OnBeforeDraw();
 
-			for (auto iter = m_Layers.rbegin(); iter != m_Layers.rend(); iter++)
+			// The topmost opaque layer covers the whole screen so the layers under it are skipped,
+			// only the textures are drawn with UseOnlyTextures so nothing covers them then
+			auto firstDrawn = m_OnlyTextures ? m_Layers.end() :
+				std::find_if(m_Layers.begin(), m_Layers.end(), [](const Layer& layer) { return layer.IsOpaque(); });
+
+			if (firstDrawn != m_Layers.end())
+				firstDrawn++;
+
+			for (auto iter = std::make_reverse_iterator(firstDrawn); iter != m_Layers.rend(); iter++)
 			{
 				if (!m_OnlyTextures)
 				{
 					if (iter->update)
 						iter->pixels->UpdateTexture();
 
-					if (iter->visible)
+					if (iter->visible && !iter->IsEmpty())
 					{
 						m_Platform->BindTexture(iter->pixels->texture->id);
 						m_Platform->DrawQuad(iter->tint);
 					}
 				}
 
-				if (iter->visible)
-				{
-					for (auto& texture : iter->textures)
-						m_Platform->DrawTexture(texture);
-				}
+				if (iter->visible && !iter->textures.empty())
+					m_Platform->DrawTextures(iter->textures, iter->vertices);
+			}
 
-				iter->textures.clear();
+			for (auto& layer : m_Layers)
+			{
+				layer.textures.clear();
+				layer.vertices.clear();
 			}
 
 			if (!OnAfterDraw())
@@ -2786,8 +5788,25 @@ namespace def
 
 			m_Platform->OnAfterDraw();
 			m_Platform->FlushScreen(m_IsVSync);
+
+			auto drawEnd = std::chrono::steady_clock::now();
+
 			m_Platform->PollEvents();
 
+			if (m_FrameTimings.is_open())
+			{
+				auto ms = [](auto duration) { return std::chrono::duration<double, std::milli>(duration).count(); };
+
+				m_FrameTimings << m_FrameIndex << ',' << m_DeltaTime << ','
+					<< ms(updateEnd - frameStart) << ',' << ms(drawEnd - updateEnd) << ','
+					<< ms(std::chrono::steady_clock::now() - frameStart) << '\n';
+			}
+
+			m_FrameIndex++;
+
+			if (m_FramesToRun > 0 && m_FrameIndex >= m_FramesToRun)
+				m_IsAppRunning = false;
+
 #ifndef PLATFORM_EMSCRIPTEN
 			m_FramesCount++;
 
@@ -2802,6 +5821,55 @@ namespace def
 		}
 	}
 
+	void GameEngine::RecordInputFrame()
+	{
+		// One line per frame: index, mouse position, wheel, held buttons mask, held keys
+		m_InputRecord << m_FrameIndex << ' ' << m_MousePos.x << ' ' << m_MousePos.y << ' ' << m_ScrollDelta << ' ';
+
+		uint32_t buttons = 0;
+		for (int i = 0; i < 8; i++)
+			buttons |= (uint32_t)m_MouseNewState[i] << i;
+
+		m_InputRecord << buttons;
+
+		for (size_t i = 0; i < (size_t)Key::KEYS_COUNT; i++)
+		{
+			if (m_KeyNewState[i])
+				m_InputRecord << ' ' << i;
+		}
+
+		m_InputRecord << '\n';
+	}
+
+	void GameEngine::ReplayInputFrame()
+	{
+		std::string line;
+
+		// When the recording ends the last replayed state is kept
+		if (!std::getline(m_InputReplay, line))
+		{
+			m_InputReplay.close();
+			return;
+		}
+
+		std::stringstream frame(line);
+
+		uint32_t index, buttons;
+		frame >> index >> m_MousePos.x >> m_MousePos.y >> m_ScrollDelta >> buttons;
+
+		for (int i = 0; i < 8; i++)
+			m_MouseNewState[i] = buttons & (1 << i);
+
+		std::fill(m_KeyNewState, m_KeyNewState + (size_t)Key::KEYS_COUNT, false);
+
+		size_t key;
+		while (frame >> key)
+		{
+			if (key < (size_t)Key::KEYS_COUNT)
+				m_KeyNewState[key] = true;
+		}
+	}
+
 	void GameEngine::MakeUnitCircle(std::vector<vf2d>& circle, const size_t verts)
 	{
 		circle.resize(verts);
@@ -2823,6 +5891,8 @@ namespace def
 		m_TimeStart = std::chrono::system_clock::now();
 		m_TimeEnd = m_TimeStart;
 
+		m_FrameIndex = 0;
+
 		for (size_t i = 0; i < (size_t)Key::KEYS_COUNT; i++)
 		{
 			m_Keys[i] = { false, false, false };
@@ -2931,642 +6001,432 @@ namespace def
 
 		m_Font.UpdateTexture();
 
-		return true;
-	}
-
-	bool GameEngine::Draw(int x, int y, const Pixel& col)
-	{
-		Layer& layer = m_Layers[m_PickedLayer];
-
-		if (!layer.target)
-			return false;
-
-		Sprite* target = layer.target->sprite;
-
-		switch (layer.pixelMode)
-		{
-		case Pixel::Mode::CUSTOM:
-			return target->SetPixel(x, y, layer.shader({ x, y }, target->GetPixel(x, y), col));
-
-		case Pixel::Mode::DEFAULT:
-			return target->SetPixel(x, y, col);
-
-		case Pixel::Mode::MASK:
-		{
-			if (col.a == 255)
-				return target->SetPixel(x, y, col);
-		}
-		break;
-
-		case Pixel::Mode::ALPHA:
-		{
-			Pixel d = target->GetPixel(x, y);
-
-			uint8_t r = uint8_t(std::lerp(d.r, col.r, (float)col.a / 255.0f));
-			uint8_t g = uint8_t(std::lerp(d.g, col.g, (float)col.a / 255.0f));
-			uint8_t b = uint8_t(std::lerp(d.b, col.b, (float)col.a / 255.0f));
-
-			return target->SetPixel(x, y, { r, g, b });
-		}
-
-		}
-
-		return false;
-	}
-
-	void GameEngine::DrawLine(int x1, int y1, int x2, int y2, const Pixel& col)
-	{
-		int dx = x2 - x1;
-		int dy = y2 - y1;
-
-		int dx1 = abs(dx);
-		int dy1 = abs(dy);
-
-		int px = 2 * dy1 - dx1;
-		int py = 2 * dx1 - dy1;
-
-		int x, y, xe, ye;
-
-		if (dy1 <= dx1)
+		for (int i = 0; i < 96; i++)
 		{
-			if (dx >= 0)
-			{
-				x = x1;
-				y = y1;
-				xe = x2;
-			}
-			else
-			{
-				x = x2;
-				y = y2;
-				xe = x1;
-			}
+			vf2d filePos(i % 16 * 8, i / 16 * 8);
 
-			Draw(x, y, col);
+			m_GlyphUVs[i][0] = (filePos + 0.0001f) * m_Font.texture->uvScale;
+			m_GlyphUVs[i][1] = (filePos + 8.0f - 0.0001f) * m_Font.texture->uvScale;
 
-			while (x < xe)
+			for (int y = 0; y < 8; y++)
 			{
-				x++;
+				uint8_t& bits = m_GlyphBits[i][y];
+				bits = 0;
 
-				if (px < 0)
-					px = px + 2 * dy1;
-				else
+				for (int x = 0; x < 8; x++)
 				{
-					y += ((dx < 0 && dy < 0) || (dx > 0 && dy > 0)) ? 1 : -1;
-					px = px + 2 * (dy1 - dx1);
+					if (m_Font.sprite->GetPixel(filePos.x + x, filePos.y + y).r > 0)
+						bits |= 1 << x;
 				}
-
-				Draw(x, y, col);
 			}
 		}
-		else
-		{
-			if (dy >= 0)
-			{
-				x = x1;
-				y = y1;
-				ye = y2;
-			}
-			else
-			{
-				x = x2;
-				y = y2;
-				ye = y1;
-			}
-
-			Draw(x, y, col);
-
-			while (y < ye)
-			{
-				y++;
-
-				if (py <= 0)
-					py = py + 2 * dx1;
-				else
-				{
-					x += ((dx < 0 && dy < 0) || (dx > 0 && dy > 0)) ? 1 : -1;
-					py = py + 2 * (dx1 - dy1);
-				}
 
-				Draw(x, y, col);
-			}
-		}
+		return true;
 	}
 
-	void GameEngine::DrawTriangle(int x1, int y1, int x2, int y2, int x3, int y3, const Pixel& col)
+	bool GameEngine::Draw(int x, int y, const Pixel& col)
 	{
-		DrawLine(x1, y1, x2, y2, col);
-		DrawLine(x2, y2, x3, y3, col);
-		DrawLine(x3, y3, x1, y1, col);
+		bool drawn = false;
+		DispatchPixelMode([&](const auto& mode) { drawn = Draw(x, y, col, mode); });
+		return drawn;
 	}
 
-	void GameEngine::FillTriangle(int x1, int y1, int x2, int y2, int x3, int y3, const Pixel& col)
+	void GameEngine::DrawSpan(int startX, int endX, int y, const Pixel& col)
 	{
-		auto draw_line = [&](int start, int end, int y)
-			{
-				for (int i = start; i <= end; i++)
-					Draw(i, y, col);
-			};
-
-		int t1x, t2x, y, minx, maxx, t1xp, t2xp;
-
-		bool changed1 = false;
-		bool changed2 = false;
-
-		int signx1, signx2, dx1, dy1, dx2, dy2;
-		int e1, e2;
-
-		if (y1 > y2)
-		{
-			std::swap(y1, y2);
-			std::swap(x1, x2);
-		}
-
-		if (y1 > y3)
-		{
-			std::swap(y1, y3);
-			std::swap(x1, x3);
-		}
-
-		if (y2 > y3)
-		{
-			std::swap(y2, y3);
-			std::swap(x2, x3);
-		}
-
-		t1x = t2x = x1;
-		y = y1;
-		dx1 = x2 - x1;
-
-		if (dx1 < 0)
-		{
-			dx1 = -dx1;
-			signx1 = -1;
-		}
-		else
-			signx1 = 1;
-
-		dy1 = y2 - y1;
-		dx2 = x3 - x1;
-
-		if (dx2 < 0)
-		{
-			dx2 = -dx2;
-			signx2 = -1;
-		}
-		else
-			signx2 = 1;
-
-		dy2 = y3 - y1;
-
-		if (dy1 > dx1)
-		{
-			std::swap(dx1, dy1);
-			changed1 = true;
-		}
+		DispatchPixelMode([&](const auto& mode) { DrawSpan(startX, endX, y, col, mode); });
+	}
 
-		if (dy2 > dx2)
-		{
-			std::swap(dy2, dx2);
-			changed2 = true;
-		}
+	bool GameEngine::SetCommandMode(const PixelMode::Default& mode, DrawCommand& command)
+	{
+		command.pixelMode = Pixel::Mode::DEFAULT;
+		return true;
+	}
 
-		e2 = dx2 >> 1;
+	bool GameEngine::SetCommandMode(const PixelMode::Mask& mode, DrawCommand& command)
+	{
+		command.pixelMode = Pixel::Mode::MASK;
+		return true;
+	}
 
-		if (y1 == y2)
-			goto next;
+	bool GameEngine::SetCommandMode(const PixelMode::Alpha& mode, DrawCommand& command)
+	{
+		command.pixelMode = Pixel::Mode::ALPHA;
+		return true;
+	}
 
-		e1 = dx1 >> 1;
+	bool GameEngine::SetCommandMode(const PixelMode::Shader& mode, DrawCommand& command)
+	{
+		command.pixelMode = Pixel::Mode::CUSTOM;
+		command.shader = mode.func;
+		return true;
+	}
 
-		for (int i = 0; i < dx1;)
-		{
-			t1xp = t2xp = 0;
+	Sprite::Content GameEngine::GetWrittenContent(const PixelMode::Default& mode, const Pixel& col)
+	{
+		return Sprite::GetContent(col);
+	}
 
-			if (t1x < t2x)
-			{
-				minx = t1x;
-				maxx = t2x;
-			}
-			else
-			{
-				minx = t2x;
-				maxx = t1x;
-			}
+	Sprite::Content GameEngine::GetWrittenContent(const PixelMode::Mask& mode, const Pixel& col)
+	{
+		return Sprite::Content::OPAQUE;
+	}
 
-			while (i++ < dx1)
-			{
-				e1 += dy1;
+	Sprite::Content GameEngine::GetWrittenContent(const PixelMode::Alpha& mode, const Pixel& col)
+	{
+		return Sprite::Content::OPAQUE;
+	}
 
-				while (e1 >= dx1)
-				{
-					e1 -= dx1;
+	Sprite::Content GameEngine::MergeContent(Sprite::Content content, Sprite::Content written)
+	{
+		return content == written ? content : Sprite::Content::UNKNOWN;
+	}
 
-					if (changed1)
-						t1xp = signx1;
-					else
-						goto next1;
-				}
+	void GameEngine::MarkWritten(Sprite* target, int x, int y, int sizeX, int sizeY, Sprite::Content written)
+	{
+		Sprite::Content content = target->m_Content;
+		target->MarkDirty(x, y, sizeX, sizeY);
+		target->m_Content = MergeContent(content, written);
+	}
 
-				if (changed1)
-					break;
-				else
-					t1x += signx1;
-			}
+	GameEngine::DrawCommand GameEngine::MakeDrawCommand(DrawCommand::Type type) const
+	{
+		const Layer& layer = m_Layers[m_PickedLayer];
 
-		next1:
-			while (1)
-			{
-				e2 += dy2;
+		DrawCommand command{};
 
-				while (e2 >= dx2)
-				{
-					e2 -= dx2;
+		command.type = type;
+		command.pixelMode = layer.pixelMode;
+		command.target = layer.target->sprite;
+		command.shader = layer.shader;
 
-					if (changed2)
-						t2xp = signx2;
-					else
-						goto next2;
-				}
+		return command;
+	}
 
-				if (changed2)
-					break;
-				else
-					t2x += signx2;
-			}
+	void GameEngine::SubmitDrawCommand(const DrawCommand& command)
+	{
+		Sprite* target = command.target;
 
-		next2:
-			if (minx > t1x) minx = t1x;
-			if (minx > t2x) minx = t2x;
-			if (maxx < t1x) maxx = t1x;
-			if (maxx < t2x) maxx = t2x;
+		int startY = command.y;
+		int endY = command.y + 1;
 
-			draw_line(minx, maxx, y);
+		// Marking the rectangle forgets the content so it's worked out again
+		Sprite::Content content = GetContentAfter(command, target->m_Content);
 
-			if (!changed1)
-				t1x += signx1;
+		switch (command.type)
+		{
+		case DrawCommand::Type::PIXEL: target->MarkDirty(command.x, command.y, 1, 1); break;
+		case DrawCommand::Type::SPAN: target->MarkDirty(command.x, command.y, command.endX - command.x + 1, 1); break;
 
-			t1x += t1xp;
+		case DrawCommand::Type::SPRITE:
+		{
+			target->MarkDirty(command.x, command.y, command.fileSizeX, command.fileSizeY);
+			endY = command.y + command.fileSizeY;
+		}
+		break;
 
-			if (!changed2)
-				t2x += signx2;
+		case DrawCommand::Type::CLEAR:
+		{
+			target->MarkDirty();
 
-			t2x += t2xp;
-			y++;
+			startY = 0;
+			endY = target->size.y;
+		}
+		break;
 
-			if (y == y2)
-				break;
 		}
 
-	next:
-		dx1 = x3 - x2;
+		target->m_Content = content;
 
-		if (dx1 < 0)
+		// The bands would write the rows that other bands are still reading
+		if (m_ParallelDrawing && std::find(m_DrawSources.begin(), m_DrawSources.end(), target) != m_DrawSources.end())
+			FlushDrawing();
+
+		if (m_ParallelDrawing && command.type == DrawCommand::Type::SPRITE)
 		{
-			dx1 = -dx1;
-			signx1 = -1;
-		}
-		else
-			signx1 = 1;
+			// The source has to be complete before it's read and the bands
+			// can't read the rows of each other so a sprite is never drawn onto itself in parallel
+			if (std::find(m_DrawTargets.begin(), m_DrawTargets.end(), command.sprite) != m_DrawTargets.end())
+				FlushDrawing();
 
-		dy1 = y3 - y2;
-		t1x = x2;
+			if (command.sprite == target)
+			{
+				ExecuteDrawCommand(command, startY, endY);
+				return;
+			}
+		}
 
-		if (dy1 > dx1)
+		if (!m_ParallelDrawing)
 		{
-			std::swap(dy1, dx1);
-			changed1 = true;
+			ExecuteDrawCommand(command, startY, endY);
+			return;
 		}
-		else
-			changed1 = false;
 
-		e1 = dx1 >> 1;
+		if (std::find(m_DrawTargets.begin(), m_DrawTargets.end(), target) == m_DrawTargets.end())
+			m_DrawTargets.push_back(target);
 
-		for (int i = 0; i <= dx1; i++)
-		{
-			t1xp = t2xp = 0;
+		if (command.type == DrawCommand::Type::SPRITE && std::find(m_DrawSources.begin(), m_DrawSources.end(), command.sprite) == m_DrawSources.end())
+			m_DrawSources.push_back(command.sprite);
 
-			if (t1x < t2x)
-			{
-				minx = t1x;
-				maxx = t2x;
-			}
-			else
-			{
-				minx = t2x;
-				maxx = t1x;
-			}
+		// The sprites flush the drawing before their pixels are set or freed
+		target->m_IsRecorded = true;
 
-			while (i < dx1)
-			{
-				e1 += dy1;
+		if (command.type == DrawCommand::Type::SPRITE)
+			command.sprite->m_IsRecorded = true;
 
-				while (e1 >= dx1)
-				{
-					e1 -= dx1;
+		size_t lastBand = (endY - 1) / s_DrawBandHeight;
 
-					if (changed1)
-					{
-						t1xp = signx1;
-						break;
-					}
-					else
-						goto next3;
-				}
+		if (m_DrawBands.size() <= lastBand)
+			m_DrawBands.resize(lastBand + 1);
 
-				if (changed1)
-					break;
-				else
-					t1x += signx1;
+		for (size_t band = startY / s_DrawBandHeight; band <= lastBand; band++)
+			m_DrawBands[band].push_back(command);
+	}
 
-				if (i < dx1) i++;
-			}
+	Sprite::Content GameEngine::GetContentAfter(const DrawCommand& command, Sprite::Content content)
+	{
+		if (command.type == DrawCommand::Type::CLEAR)
+			return Sprite::GetContent(command.col);
 
-		next3:
-			while (t2x != x3)
+		Sprite::Content written = Sprite::Content::UNKNOWN;
+
+		DispatchCommandMode(command, [&](const auto& mode)
 			{
-				e2 += dy2;
+				if (command.type == DrawCommand::Type::SPRITE)
+					written = GetWrittenContent(mode, command.sprite);
+				else
+					written = GetWrittenContent(mode, command.col);
+			});
 
-				while (e2 >= dx2)
-				{
-					e2 -= dx2;
+		return MergeContent(content, written);
+	}
 
-					if (changed2)
-						t2xp = signx2;
-					else
-						goto next4;
-				}
+	void GameEngine::ExecuteDrawCommand(const DrawCommand& command, int startY, int endY)
+	{
+		Sprite* target = command.target;
 
-				if (changed2)
-					break;
-				else
-					t2x += signx2;
-			}
+		if (command.type == DrawCommand::Type::CLEAR)
+		{
+			endY = std::min(endY, target->size.y);
 
-		next4:
-			if (minx > t1x) minx = t1x;
-			if (minx > t2x) minx = t2x;
-			if (maxx < t1x) maxx = t1x;
-			if (maxx < t2x) maxx = t2x;
+			if (startY < endY)
+				std::fill(target->pixels.begin() + startY * target->size.x, target->pixels.begin() + endY * target->size.x, command.col);
 
-			draw_line(minx, maxx, y);
+			return;
+		}
 
-			if (!changed1)
-				t1x += signx1;
+		// The rectangle of a sprite is cut to the rows, the pixels and the spans are in them or not
+		if (command.type != DrawCommand::Type::SPRITE && (command.y < startY || command.y >= endY))
+			return;
 
-			t1x += t1xp;
+		DispatchCommandMode(command, [&](const auto& mode)
+			{
+				switch (command.type)
+				{
+				case DrawCommand::Type::PIXEL:
+					WritePixel(target, command.x, command.y, command.col, mode);
+				break;
 
-			if (!changed2)
-				t2x += signx2;
+				case DrawCommand::Type::SPAN:
+					WriteSpan(target, command.x, command.endX, command.y, command.col, mode);
+				break;
 
-			t2x += t2xp;
-			y++;
+				case DrawCommand::Type::SPRITE:
+				{
+					int startRow = std::max(startY - command.y, 0);
+					int endRow = std::min(endY - command.y, command.fileSizeY);
 
-			if (y > y3)
-				return;
-		}
+					WriteSprite(target, command.x, command.y, command.fileX, command.fileY, command.fileSizeX, startRow, endRow, command.sprite, mode);
+				}
+				break;
+
+				default: break;
+
+				}
+			});
 	}
 
-	void GameEngine::DrawRectangle(int x, int y, int sizeX, int sizeY, const Pixel& col)
+	void GameEngine::SetParallelDrawing(bool enable, uint32_t threads)
 	{
-		for (int i = 0; i < sizeX - 1; i++)
-		{
-			Draw(x + i, y, col);
-			Draw(x + i, y + sizeY, col);
-		}
+		FlushDrawing();
+		StopDrawWorkers();
 
-		for (int i = 0; i < sizeY; i++)
+		m_ParallelDrawing = enable;
+
+#ifndef PLATFORM_EMSCRIPTEN
+		if (enable)
 		{
-			Draw(x, y + i, col);
-			Draw(x + sizeX - 1, y + i, col);
-		}
+			if (threads == 0)
+				threads = std::max(std::thread::hardware_concurrency(), 1u);
 
-		Draw(x + sizeX - 1, y + sizeY, col);
+			// The main thread replays the bands too
+			for (uint32_t i = 1; i < threads; i++)
+				m_DrawWorkers.emplace_back(&GameEngine::DrawWorker, this, m_DrawGeneration);
+		}
+#endif
 	}
 
-	void GameEngine::FillRectangle(int x, int y, int sizeX, int sizeY, const Pixel& col)
+	bool GameEngine::IsParallelDrawing() const
 	{
-		for (int i = 0; i < sizeX; i++)
-			for (int j = 0; j < sizeY; j++)
-				Draw(x + i, y + j, col);
+		return m_ParallelDrawing;
 	}
 
-	void GameEngine::DrawCircle(int x, int y, int radius, const Pixel& col)
+	void GameEngine::FlushDrawing()
 	{
-		int x1 = 0;
-		int y1 = radius;
-		int p1 = 3 - 2 * radius;
+		if (m_DrawTargets.empty())
+			return;
 
-		while (y1 >= x1)
+		m_NextDrawBand = 0;
+
+#ifndef PLATFORM_EMSCRIPTEN
 		{
-			Draw(x - x1, y - y1, col);
-			Draw(x - y1, y - x1, col);
-			Draw(x + y1, y - x1, col);
-			Draw(x + x1, y - y1, col);
-			Draw(x - x1, y + y1, col);
-			Draw(x - y1, y + x1, col);
-			Draw(x + y1, y + x1, col);
-			Draw(x + x1, y + y1, col);
+			std::lock_guard<std::mutex> lock(m_DrawMutex);
 
-			if (p1 < 0)
-			{
-				p1 += 4 * x1 + 6;
-				x1++;
-			}
-			else
-			{
-				p1 += 4 * (x1 - y1) + 10;
-				x1++;
-				y1--;
-			}
+			m_DrawWorkersDone = 0;
+			m_DrawGeneration++;
 		}
-	}
-
-	void GameEngine::FillCircle(int x, int y, int radius, const Pixel& col)
-	{
-		auto draw_line = [&](int start, int end, int y)
-			{
-				for (int i = start; i <= end; i++)
-					Draw(i, y, col);
-			};
 
-		int x1 = 0;
-		int y1 = radius;
-		int p1 = 3 - 2 * radius;
+		m_DrawStart.notify_all();
+		ReplayDrawBands();
 
-		while (y1 >= x1)
 		{
-			draw_line(x - x1, x + x1, y - y1);
-			draw_line(x - y1, x + y1, y - x1);
-			draw_line(x - x1, x + x1, y + y1);
-			draw_line(x - y1, x + y1, y + x1);
-
-			if (p1 < 0)
-			{
-				p1 += 4 * x1 + 6;
-				x1++;
-			}
-			else
-			{
-				p1 += 4 * (x1 - y1) + 10;
-				x1++;
-				y1--;
-			}
+			std::unique_lock<std::mutex> lock(m_DrawMutex);
+			m_DrawDone.wait(lock, [this] { return m_DrawWorkersDone == m_DrawWorkers.size(); });
 		}
-	}
+#else
+		ReplayDrawBands();
+#endif
 
-	void GameEngine::DrawEllipse(int x, int y, int sizeX, int sizeY, const Pixel& col)
-	{
-		int x1 = x + sizeX;
-		int y1 = y + sizeY;
+		for (auto& band : m_DrawBands)
+			band.clear();
 
-		int a = abs(x1 - x);
-		int b = abs(y1 - y);
-		int b1 = b & 1;
+		for (const Sprite* sprite : m_DrawTargets)
+			sprite->m_IsRecorded = false;
 
-		int dx = 4 * (1 - a) * b * b;
-		int dy = 4 * (b1 + 1) * a * a;
+		for (const Sprite* sprite : m_DrawSources)
+			sprite->m_IsRecorded = false;
 
-		int err = dx + dy + b1 * a * a;
+		m_DrawTargets.clear();
+		m_DrawSources.clear();
+	}
 
-		if (x > x1)
+	void GameEngine::ReplayDrawBands()
+	{
+		for (size_t band = m_NextDrawBand++; band < m_DrawBands.size(); band = m_NextDrawBand++)
 		{
-			x = x1;
-			x1 += a;
+			int startY = (int)band * s_DrawBandHeight;
+
+			for (const auto& command : m_DrawBands[band])
+				ExecuteDrawCommand(command, startY, startY + s_DrawBandHeight);
 		}
+	}
 
-		if (y > y1)
-			y = y1;
+	void GameEngine::StopDrawWorkers()
+	{
+#ifndef PLATFORM_EMSCRIPTEN
+		{
+			std::lock_guard<std::mutex> lock(m_DrawMutex);
+			m_StopDrawWorkers = true;
+		}
 
-		y += (b + 1) / 2;
-		y1 = y - b1;
+		m_DrawStart.notify_all();
 
-		a *= 8 * a;
-		b1 = 8 * b * b;
+		for (auto& worker : m_DrawWorkers)
+			worker.join();
 
-		do
+		m_DrawWorkers.clear();
+		m_StopDrawWorkers = false;
+#endif
+	}
+
+#ifndef PLATFORM_EMSCRIPTEN
+	void GameEngine::DrawWorker(uint32_t generation)
+	{
+		while (true)
 		{
-			Draw(x1, y, col);
-			Draw(x, y, col);
-			Draw(x, y1, col);
-			Draw(x1, y1, col);
+			{
+				std::unique_lock<std::mutex> lock(m_DrawMutex);
+				m_DrawStart.wait(lock, [&] { return m_StopDrawWorkers || m_DrawGeneration != generation; });
 
-			int e2 = 2 * err;
+				if (m_StopDrawWorkers)
+					return;
 
-			if (e2 <= dy)
-			{
-				y++;
-				y1--;
-				err += dy += a;
+				generation = m_DrawGeneration;
 			}
 
-			if (e2 >= dx || 2 * err > dy)
+			ReplayDrawBands();
+
 			{
-				x++;
-				x1--;
-				err += dx += b1;
+				std::lock_guard<std::mutex> lock(m_DrawMutex);
+				m_DrawWorkersDone++;
 			}
-		} while (x <= x1);
 
-		while (y - y1 < b)
-		{
-			Draw(x - 1, y, col);
-			Draw(x1 + 1, y++, col);
-			Draw(x - 1, y1, col);
-			Draw(x1 + 1, y1--, col);
+			m_DrawDone.notify_one();
 		}
 	}
+#endif
 
-	void GameEngine::FillEllipse(int x, int y, int sizeX, int sizeY, const Pixel& col)
+	void GameEngine::DrawLine(int x1, int y1, int x2, int y2, const Pixel& col)
 	{
-		auto draw_line = [&](int start, int end, int y)
-			{
-				for (int i = start; i <= end; i++)
-					Draw(i, y, col);
-			};
-
-		int x1 = x + sizeX;
-		int y1 = y + sizeY;
-
-		int a = abs(x1 - x);
-		int b = abs(y1 - y);
-		int b1 = b & 1;
-
-		int dx = 4 * (1 - a) * b * b;
-		int dy = 4 * (b1 + 1) * a * a;
-
-		int err = dx + dy + b1 * a * a;
+		DispatchPixelMode([&](const auto& mode) { DrawLine(x1, y1, x2, y2, col, mode); });
+	}
 
-		if (x > x1)
-		{
-			x = x1;
-			x1 += a;
-		}
+	void GameEngine::DrawTriangle(int x1, int y1, int x2, int y2, int x3, int y3, const Pixel& col)
+	{
+		DispatchPixelMode([&](const auto& mode) { DrawTriangle(x1, y1, x2, y2, x3, y3, col, mode); });
+	}
 
-		if (y > y1)
-			y = y1;
+	void GameEngine::FillTriangle(int x1, int y1, int x2, int y2, int x3, int y3, const Pixel& col)
+	{
+		DispatchPixelMode([&](const auto& mode) { FillTriangle(x1, y1, x2, y2, x3, y3, col, mode); });
+	}
 
-		y += (b + 1) / 2;
-		y1 = y - b1;
+	void GameEngine::DrawRectangle(int x, int y, int sizeX, int sizeY, const Pixel& col)
+	{
+		DispatchPixelMode([&](const auto& mode) { DrawRectangle(x, y, sizeX, sizeY, col, mode); });
+	}
 
-		a *= 8 * a;
-		b1 = 8 * b * b;
+	void GameEngine::FillRectangle(int x, int y, int sizeX, int sizeY, const Pixel& col)
+	{
+		DispatchPixelMode([&](const auto& mode) { FillRectangle(x, y, sizeX, sizeY, col, mode); });
+	}
 
-		do
-		{
-			draw_line(x, x1, y);
-			draw_line(x, x1, y1);
+	void GameEngine::DrawCircle(int x, int y, int radius, const Pixel& col)
+	{
+		DispatchPixelMode([&](const auto& mode) { DrawCircle(x, y, radius, col, mode); });
+	}
 
-			int e2 = 2 * err;
+	void GameEngine::FillCircle(int x, int y, int radius, const Pixel& col)
+	{
+		DispatchPixelMode([&](const auto& mode) { FillCircle(x, y, radius, col, mode); });
+	}
 
-			if (e2 <= dy)
-			{
-				y++;
-				y1--;
-				err += dy += a;
-			}
+	void GameEngine::DrawEllipse(int x, int y, int sizeX, int sizeY, const Pixel& col)
+	{
+		DispatchPixelMode([&](const auto& mode) { DrawEllipse(x, y, sizeX, sizeY, col, mode); });
+	}
 
-			if (e2 >= dx || 2 * err > dy)
-			{
-				x++;
-				x1--;
-				err += dx += b1;
-			}
-		} while (x <= x1);
+	void GameEngine::FillEllipse(int x, int y, int sizeX, int sizeY, const Pixel& col)
+	{
+		DispatchPixelMode([&](const auto& mode) { FillEllipse(x, y, sizeX, sizeY, col, mode); });
+	}
 
-		while (y - y1 < b)
-		{
-			draw_line(x - 1, x1 + 1, y++);
-			draw_line(x - 1, x1 + 1, y1--);
-		}
+	void GameEngine::FillPolygon(const std::vector<vf2d>& points, const Pixel& col, FillRule rule)
+	{
+		DispatchPixelMode([&](const auto& mode) { FillPolygon(points, col, rule, mode); });
 	}
 
 	void GameEngine::DrawSprite(int x, int y, const Sprite* sprite)
 	{
-		for (int j = 0; j < sprite->size.y; j++)
-			for (int i = 0; i < sprite->size.x; i++)
-				Draw(x + i, y + j, sprite->GetPixel(i, j));
+		DispatchPixelMode([&](const auto& mode) { BlitSprite(x, y, 0, 0, sprite->size.x, sprite->size.y, sprite, mode); });
 	}
 
 	void GameEngine::DrawPartialSprite(int x, int y, int fileX, int fileY, int fileSizeX, int fileSizeY, const Sprite* sprite)
 	{
-		for (int i = 0, x1 = 0; i < fileSizeX; i++, x1++)
-			for (int j = 0, y1 = 0; j < fileSizeY; j++, y1++)
-				Draw(x + x1, y + y1, sprite->GetPixel(fileX + i, fileY + j));
+		DispatchPixelMode([&](const auto& mode) { BlitSprite(x, y, fileX, fileY, fileSizeX, fileSizeY, sprite, mode); });
 	}
 
 	void GameEngine::DrawWarpedTexture(const std::vector<vf2d>& points, const Texture* tex, const Pixel& tint)
 	{
-		auto& layer = m_Layers[m_PickedLayer];
-
-		TextureInstance texInst;
-
-		texInst.texture = tex;
-		texInst.structure = layer.textureStructure;
-		texInst.points = 4;
-		texInst.tint = { tint, tint, tint, tint };
-		texInst.vertices.resize(texInst.points);
-		texInst.uv = { { 0.0f, 0.0f}, {0.0f, 1.0f}, {1.0f, 1.0f}, {1.0f, 0.0f} };
-
 		float rd = ((points[2].x - points[0].x) * (points[3].y - points[1].y) - (points[3].x - points[1].x) * (points[2].y - points[0].y));
 
 		if (rd != 0.0f)
@@ -3585,14 +6445,17 @@ namespace def
 			for (int i = 0; i < 4; i++)
 				d[i] = (points[i] - center).mag();
 
+			static constexpr vf2d uv[4] = { { 0.0f, 0.0f }, { 0.0f, 1.0f }, { 1.0f, 1.0f }, { 1.0f, 0.0f } };
+			TextureVertex* verts = PushTextureInstance(tex, m_Layers[m_PickedLayer].textureStructure, 4);
+
 			for (int i = 0; i < 4; i++)
 			{
 				float q = d[i] == 0.0f ? 1.0f : (d[i] + d[(i + 2) & 3]) / d[(i + 2) & 3];
-				texInst.uv[i] *= q;
-				texInst.vertices[i] = { (points[i].x * m_InvScreenSize.x) * 2.0f - 1.0f, ((points[i].y * m_InvScreenSize.y) * 2.0f - 1.0f) * -1.0f };
-			}
 
-			layer.textures.push_back(texInst);
+				verts[i].pos = { (points[i].x * m_InvScreenSize.x) * 2.0f - 1.0f, ((points[i].y * m_InvScreenSize.y) * 2.0f - 1.0f) * -1.0f };
+				verts[i].uv = uv[i] * q;
+				verts[i].tint = tint;
+			}
 		}
 	}
 
@@ -3626,43 +6489,7 @@ namespace def
 			coordinates[i].y = (modelCoordinates[i].x * sn + modelCoordinates[i].y * cs) * scale + y;
 		}
 
-		auto GetAngle = [](const vf2d& p1, const vf2d& p2)
-			{
-				float a = atan2(p2.y, p2.x) - atan2(p1.y, p1.x);
-				while (a > 3.14159f) a -= 3.14159f * 2.0f;
-				while (a < -3.14159f) a += 3.14159f * 2.0f;
-				return a;
-			};
-
-		auto PointInPolygon = [&](const vf2d& p)
-			{
-				float angle = 0.0f;
-
-				for (size_t i = 0; i < verts; i++)
-					angle += GetAngle(coordinates[i] - p, coordinates[(i + 1) % verts] - p);
-
-				return std::abs(angle) >= 3.14159f;
-			};
-
-		vf2d min = coordinates.front();
-		vf2d max = coordinates.front();
-
-		for (size_t i = 1; i < verts; i++)
-		{
-			if (min.x > coordinates[i].x) min.x = coordinates[i].x;
-			if (min.y > coordinates[i].y) min.y = coordinates[i].y;
-
-			if (max.x < coordinates[i].x) max.x = coordinates[i].x;
-			if (max.y < coordinates[i].y) max.y = coordinates[i].y;
-		}
-
-		vf2d point;
-		for (point.x = min.x; point.x < max.x; point.x++)
-			for (point.y = min.y; point.y < max.y; point.y++)
-			{
-				if (PointInPolygon(point))
-					Draw(point, col);
-			}
+		FillPolygon(coordinates, col);
 	}
 
 	void GameEngine::DrawString(int x, int y, std::string_view s, const Pixel& col, uint32_t scaleX, uint32_t scaleY)
@@ -3681,30 +6508,31 @@ namespace def
 				sx += 8 * m_TabSize * scaleX;
 			else
 			{
-				int ox = (c - 32) % 16;
-				int oy = (c - 32) / 16;
+				uint8_t glyph = c - 32;
 
-				if (scaleX > 1 || scaleY > 1)
-				{
-					for (uint32_t i = 0; i < 8; i++)
-						for (uint32_t j = 0; j < 8; j++)
-						{
-							if (m_Font.sprite->GetPixel(i + ox * 8, j + oy * 8).r > 0)
-							{
-								for (uint32_t is = 0; is < scaleX; is++)
-									for (uint32_t js = 0; js < scaleY; js++)
-										Draw(x + sx + i * scaleX + is, y + sy + j * scaleY + js, col);
-							}
-						}
-				}
-				else
+				if (glyph < 96)
 				{
-					for (uint32_t i = 0; i < 8; i++)
-						for (uint32_t j = 0; j < 8; j++)
+					for (int j = 0; j < 8; j++)
+					{
+						uint32_t bits = m_GlyphBits[glyph][j];
+
+						// Every run of set bits is drawn as a single span
+						for (int i = 0; bits != 0;)
 						{
-							if (m_Font.sprite->GetPixel(i + ox * 8, j + oy * 8).r > 0)
-								Draw(x + sx + i, y + sy + j, col);
+							for (; (bits & 1) == 0; bits >>= 1)
+								i++;
+
+							int start = i;
+
+							for (; (bits & 1) == 1; bits >>= 1)
+								i++;
+
+							if (scaleX > 1 || scaleY > 1)
+								FillRectangle(x + sx + start * scaleX, y + sy + j * scaleY, (i - start) * scaleX, scaleY, col);
+							else
+								DrawSpan(x + sx + start, x + sx + i - 1, y + sy + j, col);
 						}
+					}
 				}
 
 				sx += 8 * scaleX;
@@ -3714,7 +6542,13 @@ namespace def
 
 	void GameEngine::Clear(const Pixel& col)
 	{
-		m_Layers[m_PickedLayer].target->sprite->SetPixelData(col);
+		if (!m_Layers[m_PickedLayer].target)
+			return;
+
+		DrawCommand command = MakeDrawCommand(DrawCommand::Type::CLEAR);
+		command.col = col;
+
+		SubmitDrawCommand(command);
 	}
 
 	KeyState GameEngine::GetKey(Key k) const { return m_Keys[static_cast<size_t>(k)]; }
@@ -3742,6 +6576,8 @@ namespace def
 
 	void GameEngine::SetDrawTarget(Graphic* target)
 	{
+		FlushDrawing();
+
 		m_Layers[m_PickedLayer].target = target ? target : m_Layers[m_PickedLayer].pixels;
 		m_Layers[m_PickedLayer].target->UpdateTexture();
 	}
@@ -3791,100 +6627,156 @@ namespace def
 		DrawLine(pos1.x, pos1.y, pos2.x, pos2.y, col);
 	}
 
-	void GameEngine::DrawTexturePolygon(const std::vector<vf2d>& verts, const std::vector<Pixel>& cols, Texture::Structure structure)
+	TextureVertex* GameEngine::PushTextureInstance(const Texture* tex, Texture::Structure structure, uint32_t points)
 	{
+		auto& layer = m_Layers[m_PickedLayer];
+
 		TextureInstance texInst;
 
-		texInst.texture = nullptr;
-		texInst.points = verts.size();
+		texInst.texture = tex;
 		texInst.structure = structure;
+		texInst.points = points;
+		texInst.offset = (uint32_t)layer.vertices.size();
 
-		texInst.tint.resize(verts.size());
+		layer.textures.push_back(texInst);
+		layer.vertices.resize(layer.vertices.size() + points);
 
-		if (cols.size() > 1)
-		{
-			std::copy(
-				cols.begin(),
-				cols.end(),
-				texInst.tint.begin());
-		}
-		else
-		{
-			std::fill(
-				texInst.tint.begin(),
-				texInst.tint.end(),
-				cols[0]);
-		}
+		return layer.vertices.data() + texInst.offset;
+	}
+
+	void GameEngine::DrawTexturePolygon(const std::vector<vf2d>& verts, const std::vector<Pixel>& cols, Texture::Structure structure)
+	{
+		DrawTexturePolygon(verts.data(), cols.data(), (uint32_t)verts.size(), cols.size() > 1, structure);
+	}
 
-		texInst.uv.resize(verts.size());
-		texInst.vertices.resize(verts.size());
+	void GameEngine::DrawTexturePolygon(const vf2d* verts, const Pixel* cols, uint32_t count, bool gradient, Texture::Structure structure)
+	{
+		TextureVertex* dest = PushTextureInstance(nullptr, structure, count);
 
-		for (size_t i = 0; i < verts.size(); i++)
+		for (uint32_t i = 0; i < count; i++)
 		{
-			texInst.vertices[i].x = verts[i].x * m_InvScreenSize.x * 2.0f - 1.0f;
-			texInst.vertices[i].y = 1.0f - verts[i].y * m_InvScreenSize.y * 2.0f;
+			dest[i].pos.x = verts[i].x * m_InvScreenSize.x * 2.0f - 1.0f;
+			dest[i].pos.y = 1.0f - verts[i].y * m_InvScreenSize.y * 2.0f;
+			dest[i].uv = { 0.0f, 0.0f };
+			dest[i].tint = gradient ? cols[i] : cols[0];
 		}
-
-		m_Layers[m_PickedLayer].textures.push_back(texInst);
 	}
 
 	void GameEngine::DrawTextureLine(const vi2d& pos1, const vi2d& pos2, const Pixel& col)
 	{
-		DrawTexturePolygon({ pos1, pos2 }, { col, col }, Texture::Structure::WIREFRAME);
+		vf2d verts[] = { pos1, pos2 };
+		DrawTexturePolygon(verts, &col, 2, false, Texture::Structure::WIREFRAME);
 	}
 
 	void GameEngine::DrawTextureTriangle(const vi2d& pos1, const vi2d& pos2, const vi2d& pos3, const Pixel& col)
 	{
-		DrawTexturePolygon({ pos1, pos2, pos3 }, { col, col, col }, Texture::Structure::WIREFRAME);
+		vf2d verts[] = { pos1, pos2, pos3 };
+		DrawTexturePolygon(verts, &col, 3, false, Texture::Structure::WIREFRAME);
 	}
 
 	void GameEngine::FillTextureTriangle(const vi2d& pos1, const vi2d& pos2, const vi2d& pos3, const Pixel& col)
 	{
-		DrawTexturePolygon({ pos1, pos2, pos3 }, { col, col, col }, Texture::Structure::FAN);
+		vf2d verts[] = { pos1, pos2, pos3 };
+		DrawTexturePolygon(verts, &col, 3, false, Texture::Structure::FAN);
 	}
 
 	void GameEngine::DrawTextureRectangle(const vi2d& pos, const vi2d& size, const Pixel& col)
 	{
-		DrawTexturePolygon({ pos, { float(pos.x + size.x), (float)pos.y }, pos + size, { (float)pos.x, float(pos.y + size.y) } }, { col, col, col, col }, Texture::Structure::WIREFRAME);
+		vf2d verts[] = { pos, { float(pos.x + size.x), (float)pos.y }, pos + size, { (float)pos.x, float(pos.y + size.y) } };
+		DrawTexturePolygon(verts, &col, 4, false, Texture::Structure::WIREFRAME);
 	}
 
 	void GameEngine::FillTextureRectangle(const vi2d& pos, const vi2d& size, const Pixel& col)
 	{
-		DrawTexturePolygon({ pos, { float(pos.x + size.x), (float)pos.y }, pos + size, { (float)pos.x, float(pos.y + size.y) } }, { col, col, col, col }, Texture::Structure::FAN);
+		vf2d verts[] = { pos, { float(pos.x + size.x), (float)pos.y }, pos + size, { (float)pos.x, float(pos.y + size.y) } };
+		DrawTexturePolygon(verts, &col, 4, false, Texture::Structure::FAN);
 	}
 
 	void GameEngine::DrawTextureCircle(const vi2d& pos, int radius, const Pixel& col)
 	{
-		std::vector<vf2d> verts(s_UnitCircle.size());
-
-		for (size_t i = 0; i < verts.size(); i++)
-			verts[i] = s_UnitCircle[i] * (float)radius + pos;
+		TextureVertex* dest = PushTextureInstance(nullptr, Texture::Structure::WIREFRAME, (uint32_t)s_UnitCircle.size());
 
-		DrawTexturePolygon(verts, { col }, Texture::Structure::WIREFRAME);
+		for (size_t i = 0; i < s_UnitCircle.size(); i++)
+		{
+			vf2d p = s_UnitCircle[i] * (float)radius + pos;
+			dest[i] = { { p.x * m_InvScreenSize.x * 2.0f - 1.0f, 1.0f - p.y * m_InvScreenSize.y * 2.0f }, { 0.0f, 0.0f }, col };
+		}
 	}
 
 	void GameEngine::FillTextureCircle(const vi2d& pos, int radius, const Pixel& col)
 	{
-		std::vector<vf2d> verts(s_UnitCircle.size());
+		TextureVertex* dest = PushTextureInstance(nullptr, Texture::Structure::FAN, (uint32_t)s_UnitCircle.size());
 
-		for (size_t i = 0; i < verts.size(); i++)
-			verts[i] = s_UnitCircle[i] * (float)radius + pos;
-
-		DrawTexturePolygon(verts, { col }, Texture::Structure::FAN);
+		for (size_t i = 0; i < s_UnitCircle.size(); i++)
+		{
+			vf2d p = s_UnitCircle[i] * (float)radius + pos;
+			dest[i] = { { p.x * m_InvScreenSize.x * 2.0f - 1.0f, 1.0f - p.y * m_InvScreenSize.y * 2.0f }, { 0.0f, 0.0f }, col };
+		}
 	}
 
 	void GameEngine::GradientTextureTriangle(const vi2d& pos1, const vi2d& pos2, const vi2d& pos3, const Pixel& col1, const Pixel& col2, const Pixel& col3)
 	{
-		DrawTexturePolygon({ pos1, pos2, pos3 }, { col1, col2, col3 }, Texture::Structure::FAN);
+		vf2d verts[] = { pos1, pos2, pos3 };
+		Pixel cols[] = { col1, col2, col3 };
+		DrawTexturePolygon(verts, cols, 3, true, Texture::Structure::FAN);
 	}
 
 	void GameEngine::GradientTextureRectangle(const vi2d& pos, const vi2d& size, const Pixel& colTL, const Pixel& colTR, const Pixel& colBR, const Pixel& colBL)
 	{
-		DrawTexturePolygon({ pos, { float(pos.x + size.x), (float)pos.y }, pos + size, { (float)pos.x, float(pos.y + size.y) } }, { colTL, colTR, colBR, colBL }, Texture::Structure::FAN);
+		vf2d verts[] = { pos, { float(pos.x + size.x), (float)pos.y }, pos + size, { (float)pos.x, float(pos.y + size.y) } };
+		Pixel cols[] = { colTL, colTR, colBR, colBL };
+		DrawTexturePolygon(verts, cols, 4, true, Texture::Structure::FAN);
 	}
 
 	void GameEngine::DrawTextureString(const vi2d& pos, std::string_view text, const Pixel& col, const vf2d& scale)
 	{
+		uint32_t points = GetTextureStringPoints(text);
+
+		if (points > 0)
+			BuildTextureString(PushTextureInstance(m_Font.texture, Texture::Structure::DEFAULT, points), pos, text, col, scale);
+	}
+
+	void GameEngine::DrawTextureString(TextCache& cache, const vi2d& pos, std::string_view text, const Pixel& col, const vf2d& scale)
+	{
+		if (cache.m_Text != text || cache.m_Pos != pos || cache.m_Col != col || cache.m_Col.a != col.a || cache.m_Scale != scale ||
+			cache.m_WindowSize != m_WindowSize || cache.m_TabSize != m_TabSize)
+		{
+			cache.m_Text = text;
+			cache.m_Pos = pos;
+			cache.m_Col = col;
+			cache.m_Scale = scale;
+			cache.m_WindowSize = m_WindowSize;
+			cache.m_TabSize = m_TabSize;
+
+			cache.m_Vertices.resize(GetTextureStringPoints(text));
+			BuildTextureString(cache.m_Vertices.data(), pos, text, col, scale);
+		}
+
+		if (!cache.m_Vertices.empty())
+		{
+			TextureVertex* dest = PushTextureInstance(m_Font.texture, Texture::Structure::DEFAULT, (uint32_t)cache.m_Vertices.size());
+			std::copy(cache.m_Vertices.begin(), cache.m_Vertices.end(), dest);
+		}
+	}
+
+	uint32_t GameEngine::GetTextureStringPoints(std::string_view text)
+	{
+		uint32_t glyphs = 0;
+
+		for (auto c : text)
+		{
+			if (uint8_t(c - 32) < 96)
+				glyphs++;
+		}
+
+		return glyphs * 6;
+	}
+
+	void GameEngine::BuildTextureString(TextureVertex* dest, const vi2d& pos, std::string_view text, const Pixel& col, const vf2d& scale)
+	{
+		vf2d window = m_WindowSize;
+		vf2d glyphSize = scale * 8.0f;
+
 		vf2d p = { 0.0f, 0.0f };
 
 		for (auto c : text)
@@ -3892,18 +6784,33 @@ namespace def
 			if (c == '\n')
 			{
 				p.x = 0;
-				p.y += 8.0f * scale.y;
+				p.y += glyphSize.y;
 			}
 			else if (c == '\t')
 			{
-				p.x += 8.0f * float(m_TabSize) * scale.x;
+				p.x += glyphSize.x * float(m_TabSize);
 			}
-			else
+			else if (uint8_t(c - 32) < 96)
 			{
-				vf2d offset((c - 32) % 16, (c - 32) / 16);
+				// Snap the corners to the pixels of the window the same way DrawPartialTexture does
+				vf2d screenPos1 = ((pos + p) * m_InvScreenSize * 2.0f - 1.0f) * vf2d(1.0f, -1.0f);
+				vf2d screenPos2 = ((pos + p + glyphSize) * m_InvScreenSize * 2.0f - 1.0f) * vf2d(1.0f, -1.0f);
+
+				vf2d pos1 = (screenPos1 * window + vf2d(0.5f, 0.5f)).floor() / window;
+				vf2d pos2 = (screenPos2 * window + vf2d(0.5f, -0.5f)).ceil() / window;
 
-				DrawPartialTexture(pos + p, m_Font.texture, offset * 8.0f, { 8.0f, 8.0f }, scale, col);
-				p.x += 8.0f * scale.x;
+				const vf2d& tl = m_GlyphUVs[c - 32][0];
+				const vf2d& br = m_GlyphUVs[c - 32][1];
+
+				dest[0] = { pos1, tl, col };
+				dest[1] = { { pos1.x, pos2.y }, { tl.x, br.y }, col };
+				dest[2] = { pos2, br, col };
+				dest[3] = dest[0];
+				dest[4] = dest[2];
+				dest[5] = { { pos2.x, pos1.y }, { br.x, tl.y }, col };
+
+				dest += 6;
+				p.x += glyphSize.x;
 			}
 		}
 	}
@@ -3960,26 +6867,19 @@ namespace def
 
 	void GameEngine::DrawTexture(const vf2d& pos, const Texture* tex, const vf2d& scale, const Pixel& tint)
 	{
-		auto& layer = m_Layers[m_PickedLayer];
-
 		vf2d pos1 = (pos * m_InvScreenSize * 2.0f - 1.0f) * vf2d(1.0f, -1.0f);
 		vf2d pos2 = pos1 + 2.0f * tex->size * m_InvScreenSize * scale * vf2d(1.0f, -1.0f);
 
-		TextureInstance texInst;
-
-		texInst.texture = tex;
-		texInst.points = 4;
-		texInst.structure = layer.textureStructure;
-		texInst.tint = { tint, tint, tint, tint };
-		texInst.vertices = { pos1, { pos1.x, pos2.y }, pos2, { pos2.x, pos1.y } };
+		TextureVertex* verts = PushTextureInstance(tex, m_Layers[m_PickedLayer].textureStructure, 4);
 
-		layer.textures.push_back(texInst);
+		verts[0] = { pos1, { 0.0f, 0.0f }, tint };
+		verts[1] = { { pos1.x, pos2.y }, { 0.0f, 1.0f }, tint };
+		verts[2] = { pos2, { 1.0f, 1.0f }, tint };
+		verts[3] = { { pos2.x, pos1.y }, { 1.0f, 0.0f }, tint };
 	}
 
 	void GameEngine::DrawPartialTexture(const vf2d& pos, const Texture* tex, const vf2d& filePos, const vf2d& fileSize, const vf2d& scale, const Pixel& tint)
 	{
-		auto& layer = m_Layers[m_PickedLayer];
-
 		vf2d screenPos1 = (pos * m_InvScreenSize * 2.0f - 1.0f) * vf2d(1.0f, -1.0f);
 		vf2d screenPos2 = ((pos + fileSize * scale) * m_InvScreenSize * 2.0f - 1.0f) * vf2d(1.0f, -1.0f);
 
@@ -3989,95 +6889,67 @@ namespace def
 		vf2d tl = (filePos + 0.0001f) * tex->uvScale;
 		vf2d br = (filePos + fileSize - 0.0001f) * tex->uvScale;
 
-		TextureInstance texInst;
-
-		texInst.texture = tex;
-		texInst.points = 4;
-		texInst.structure = layer.textureStructure;
-		texInst.tint = { tint, tint, tint, tint };
-		texInst.vertices = { quantPos1, { quantPos1.x, quantPos2.y }, quantPos2, { quantPos2.x, quantPos1.y } };
-		texInst.uv = { tl, { tl.x, br.y }, br, { br.x, tl.y } };
+		TextureVertex* verts = PushTextureInstance(tex, m_Layers[m_PickedLayer].textureStructure, 4);
 
-		layer.textures.push_back(texInst);
+		verts[0] = { quantPos1, tl, tint };
+		verts[1] = { { quantPos1.x, quantPos2.y }, { tl.x, br.y }, tint };
+		verts[2] = { quantPos2, br, tint };
+		verts[3] = { { quantPos2.x, quantPos1.y }, { br.x, tl.y }, tint };
 	}
 
 	void GameEngine::DrawRotatedTexture(const vf2d& pos, const Texture* tex, float rotation, const vf2d& center, const vf2d& scale, const Pixel& tint)
 	{
-		auto& layer = m_Layers[m_PickedLayer];
-
-		TextureInstance texInst;
-
-		texInst.texture = tex;
-		texInst.points = 4;
-		texInst.structure = layer.textureStructure;
-		texInst.tint = { tint, tint, tint, tint };
+		TextureVertex* verts = PushTextureInstance(tex, m_Layers[m_PickedLayer].textureStructure, 4);
 
 		vf2d denormCenter = center * tex->size;
 
-		texInst.vertices = {
-			-denormCenter * scale,
-			(vf2d(0.0f, tex->size.y) - denormCenter) * scale,
-			(tex->size - denormCenter) * scale,
-			(vf2d(tex->size.x, 0.0f) - denormCenter) * scale
-		};
+		verts[0] = { -denormCenter * scale, { 0.0f, 0.0f }, tint };
+		verts[1] = { (vf2d(0.0f, tex->size.y) - denormCenter) * scale, { 0.0f, 1.0f }, tint };
+		verts[2] = { (tex->size - denormCenter) * scale, { 1.0f, 1.0f }, tint };
+		verts[3] = { (vf2d(tex->size.x, 0.0f) - denormCenter) * scale, { 1.0f, 0.0f }, tint };
 
 		float c = cos(rotation), s = sin(rotation);
-		for (size_t i = 0; i < texInst.points; i++)
+		for (size_t i = 0; i < 4; i++)
 		{
 			vf2d offset =
 			{
-				texInst.vertices[i].x * c - texInst.vertices[i].y * s,
-				texInst.vertices[i].x * s + texInst.vertices[i].y * c
+				verts[i].pos.x * c - verts[i].pos.y * s,
+				verts[i].pos.x * s + verts[i].pos.y * c
 			};
 
-			texInst.vertices[i] = pos + offset;
-			texInst.vertices[i] = texInst.vertices[i] * m_InvScreenSize * 2.0f - 1.0f;
-			texInst.vertices[i].y *= -1.0f;
+			verts[i].pos = pos + offset;
+			verts[i].pos = verts[i].pos * m_InvScreenSize * 2.0f - 1.0f;
+			verts[i].pos.y *= -1.0f;
 		}
-
-		layer.textures.push_back(texInst);
 	}
 
 	void GameEngine::DrawPartialRotatedTexture(const vf2d& pos, const Texture* tex, const vf2d& filePos, const vf2d& fileSize, float rotation, const vf2d& center, const vf2d& scale, const Pixel& tint)
 	{
-		auto& layer = m_Layers[m_PickedLayer];
-
-		TextureInstance texInst;
-
-		texInst.texture = tex;
-		texInst.points = 4;
-		texInst.structure = layer.textureStructure;
-		texInst.tint = { tint, tint, tint, tint };
+		TextureVertex* verts = PushTextureInstance(tex, m_Layers[m_PickedLayer].textureStructure, 4);
 
 		vf2d denormCenter = center * fileSize;
 
-		texInst.vertices = {
-			-denormCenter * scale,
-			(vf2d(0.0f, fileSize.y) - denormCenter) * scale,
-			(fileSize - denormCenter) * scale,
-			(vf2d(fileSize.x, 0.0f) - denormCenter) * scale
-		};
+		vf2d tl = filePos * tex->uvScale;
+		vf2d br = tl + fileSize * tex->uvScale;
+
+		verts[0] = { -denormCenter * scale, tl, tint };
+		verts[1] = { (vf2d(0.0f, fileSize.y) - denormCenter) * scale, { tl.x, br.y }, tint };
+		verts[2] = { (fileSize - denormCenter) * scale, br, tint };
+		verts[3] = { (vf2d(fileSize.x, 0.0f) - denormCenter) * scale, { br.x, tl.y }, tint };
 
 		float c = cos(rotation), s = sin(rotation);
-		for (size_t i = 0; i < texInst.points; i++)
+		for (size_t i = 0; i < 4; i++)
 		{
 			vf2d offset =
 			{
-				texInst.vertices[i].x * c - texInst.vertices[i].y * s,
-				texInst.vertices[i].x * s + texInst.vertices[i].y * c
+				verts[i].pos.x * c - verts[i].pos.y * s,
+				verts[i].pos.x * s + verts[i].pos.y * c
 			};
 
-			texInst.vertices[i] = pos + offset;
-			texInst.vertices[i] = texInst.vertices[i] * m_InvScreenSize * 2.0f - 1.0f;
-			texInst.vertices[i].y *= -1.0f;
+			verts[i].pos = pos + offset;
+			verts[i].pos = verts[i].pos * m_InvScreenSize * 2.0f - 1.0f;
+			verts[i].pos.y *= -1.0f;
 		}
-
-		vf2d tl = filePos * tex->uvScale;
-		vf2d br = tl + fileSize * tex->uvScale;
-
-		texInst.uv = { tl, { tl.x, br.y }, br, { br.x, tl.y } };
-
-		layer.textures.push_back(texInst);
 	}
 
 	void GameEngine::DrawWireFrameModel(const std::vector<vf2d>& modelCoordinates, const vf2d& pos, float rotation, float scale, const Pixel& col)
@@ -4193,6 +7065,40 @@ namespace def
 		return m_DeltaTime;
 	}
 
+	void GameEngine::SetFixedTimeStep(float deltaTime, uint32_t frames)
+	{
+		m_FixedDeltaTime = deltaTime;
+		m_FramesToRun = frames;
+	}
+
+	uint32_t GameEngine::GetFrameIndex() const
+	{
+		return m_FrameIndex;
+	}
+
+	bool GameEngine::RecordInput(std::string_view fileName)
+	{
+		m_InputRecord.open(fileName.data());
+		return m_InputRecord.is_open();
+	}
+
+	bool GameEngine::ReplayInput(std::string_view fileName)
+	{
+		m_InputReplay.open(fileName.data());
+		return m_InputReplay.is_open();
+	}
+
+	bool GameEngine::WriteFrameTimings(std::string_view fileName)
+	{
+		m_FrameTimings.open(fileName.data());
+
+		if (!m_FrameTimings.is_open())
+			return false;
+
+		m_FrameTimings << "frame,delta,update_ms,draw_ms,frame_ms\n";
+		return true;
+	}
+
 	size_t GameEngine::CreateLayer(const vi2d& offset, const vi2d& size, bool update, bool visible, const Pixel& tint)
 	{
 		Layer layer;